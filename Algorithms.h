@@ -0,0 +1,178 @@
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include <cassert>
+#include <cstring>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+namespace detail {
+
+// Position inside a segment table that remembers how many elements are
+// left in the current segment. Never rests at the end of a segment unless
+// it is the end of the whole table.
+template < class ContainerIt >
+struct SegmentCursor {
+    using ElementIt = decltype(std::declval<range<ContainerIt>>().begin());
+
+    SegmentCursor( MultiRange<ContainerIt>& ranges ) :
+        ranges( ranges ),
+        table( ranges.data() ),
+        range_it( ranges.data() ),
+        range_end( ranges.data() + ranges.size() ),
+        element(),
+        remaining(0)
+    {
+        if( range_it != range_end )
+            enter();
+    }
+
+    bool done() const { return remaining == 0; }
+
+    void advance( size_t n ) {
+        assert( n <= remaining );
+        std::advance( element, n );
+        remaining -= n;
+        if( remaining == 0 && range_it + 1 != range_end ) {
+            ++range_it;
+            enter();
+        }
+    }
+
+    typename MultiRange<ContainerIt>::iterator position() const {
+        return ranges.make_iterator( range_it - table, element );
+    }
+
+    const MultiRange<ContainerIt>& ranges;
+    range<ContainerIt>* table;
+    range<ContainerIt>* range_it;
+    range<ContainerIt>* range_end;
+    ElementIt           element;
+    size_t              remaining;
+
+private:
+    // Skips empty segments
+    void enter() {
+        for( ;; ) {
+            element = range_it->begin();
+            remaining = std::distance( element, range_it->end() );
+            if( remaining > 0 || range_it + 1 == range_end )
+                break;
+            ++range_it;
+        }
+    }
+};
+
+// Whether equality of two values can be decided comparing their bytes
+template < class T, class U >
+struct bytewise_comparable : std::integral_constant<bool,
+        std::is_same<std::remove_cv_t<T>, std::remove_cv_t<U>>::value
+     && ( std::is_integral<std::remove_cv_t<T>>::value
+       || std::is_enum<std::remove_cv_t<T>>::value
+       || std::is_pointer<std::remove_cv_t<T>>::value )>
+{
+};
+
+// Length of the common prefix of two sequences of n elements
+template < class ItA, class ItB >
+size_t common_prefix( ItA a, ItB b, size_t n, std::false_type ) {
+    size_t i = 0;
+    while( i < n && *a == *b ) {
+        ++a; ++b; ++i;
+    }
+    return i;
+}
+
+// Length of the common prefix of two sequences of n elements.
+// Compares whole blocks with memcmp and only looks at individual elements
+// inside the block that differs.
+template < class ItA, class ItB >
+size_t common_prefix( ItA a, ItB b, size_t n, std::true_type ) {
+    if( n == 0 )
+        return 0;
+    auto* pa = std::addressof(*a);
+    auto* pb = std::addressof(*b);
+    constexpr size_t block = std::max<size_t>( 1, 256 / sizeof(*pa) );
+    for( size_t i = 0; i < n; i += block ) {
+        size_t length = std::min( block, n - i );
+        if( std::memcmp( pa + i, pb + i, length * sizeof(*pa) ) != 0 )
+            return i + common_prefix( pa + i, pb + i, length, std::false_type() );
+    }
+    return n;
+}
+
+template < class ItA, class ItB >
+size_t common_prefix( ItA a, ItB b, size_t n ) {
+    using A = std::remove_reference_t<decltype(*a)>;
+    using B = std::remove_reference_t<decltype(*b)>;
+    using bytewise = std::integral_constant<bool,
+                        is_contiguous_iterator<ItA>::value
+                     && is_contiguous_iterator<ItB>::value
+                     && bytewise_comparable<A,B>::value>;
+    return common_prefix( a, b, n, bytewise() );
+}
+
+// Advances both cursors up to the first position where they differ
+template < class ItA, class ItB >
+void skip_common_prefix( SegmentCursor<ItA>& a, SegmentCursor<ItB>& b ) {
+    while( !a.done() && !b.done() ) {
+        // Overlap of both current segments
+        size_t n = std::min( a.remaining, b.remaining );
+        size_t equal = common_prefix( a.element, b.element, n );
+        a.advance( equal );
+        b.advance( equal );
+        if( equal < n )
+            break;
+    }
+}
+
+} // namespace detail
+
+// Finds the first position where two concatenations differ.
+// Segments of both sides do not need to be cut at the same places.
+template < class ItA, class ItB >
+std::pair<typename MultiRange<ItA>::iterator, typename MultiRange<ItB>::iterator>
+mismatch( MultiRange<ItA> a, MultiRange<ItB> b )
+{
+    UTIL_TRACE_ALGORITHM( "mismatch", a.size() + b.size() );
+    detail::SegmentCursor<ItA> ca(a);
+    detail::SegmentCursor<ItB> cb(b);
+    detail::skip_common_prefix( ca, cb );
+    return { ca.done()? a.end() : ca.position(),
+             cb.done()? b.end() : cb.position() };
+}
+
+// Whether two concatenations hold the same sequence of elements
+template < class ItA, class ItB >
+bool equal( MultiRange<ItA> a, MultiRange<ItB> b )
+{
+    UTIL_TRACE_ALGORITHM( "equal", a.size() + b.size() );
+    detail::SegmentCursor<ItA> ca(a);
+    detail::SegmentCursor<ItB> cb(b);
+    detail::skip_common_prefix( ca, cb );
+    return ca.done() && cb.done();
+}
+
+// Lexicographically compares two concatenations.
+// Returns a negative value if a sorts before b, zero if they are equal or
+// a positive value if a sorts after b.
+template < class ItA, class ItB >
+int compare( MultiRange<ItA> a, MultiRange<ItB> b )
+{
+    UTIL_TRACE_ALGORITHM( "compare", a.size() + b.size() );
+    detail::SegmentCursor<ItA> ca(a);
+    detail::SegmentCursor<ItB> cb(b);
+    detail::skip_common_prefix( ca, cb );
+    if( ca.done() || cb.done() )
+        return int(!ca.done()) - int(!cb.done());
+    return *ca.element < *cb.element? -1 : 1;
+}
+
+} // namespace util
@@ -0,0 +1,74 @@
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Calls f(first, n) over consecutive blocks of at most block_size
+// elements, in order, following the strategy of the MultiRange profile:
+//
+//  - per_segment: blocks point into the segments themselves.
+//  - gather:      runs of tiny segments are copied into a scratch buffer
+//                 and handed out together; longer segments are still
+//                 handed out in place.
+//  - elementwise: every element is copied into the scratch buffer.
+//
+// Blocks must be treated as read-only, since they may be copies.
+template < class ContainerIt, class F >
+void for_each_block( MultiRange<ContainerIt> ranges, size_t block_size, F f ) {
+    using T = typename std::iterator_traits<ContainerIt>::value_type;
+    const SegmentStrategy strategy = ranges.profile().strategy;
+    range<ContainerIt>* table = ranges.data();
+
+    std::vector<T> scratch;
+    if( strategy != SegmentStrategy::per_segment )
+        scratch.reserve( block_size );
+    auto flush = [&]() {
+        if( !scratch.empty() ) {
+            f( static_cast<const T*>(scratch.data()), scratch.size() );
+            scratch.clear();
+        }
+    };
+
+    for( size_t s = 0; s < ranges.size(); ++s ) {
+        range<ContainerIt>& segment = table[s];
+        if constexpr( is_contiguous_iterator<ContainerIt>::value ) {
+            auto elements = contiguous( segment );
+            size_t length = elements.last - elements.first;
+            UTIL_SEGMENT_SCOPE( table, s, length );
+            if( strategy == SegmentStrategy::gather && length < tiny_segment_size ) {
+                for( auto p = elements.first; p != elements.last; ) {
+                    size_t n = std::min<size_t>( block_size - scratch.size(), elements.last - p );
+                    scratch.insert( scratch.end(), p, p + n );
+                    p += n;
+                    if( scratch.size() == block_size )
+                        flush();
+                }
+                continue;
+            }
+            // Keep the order: gathered elements go first
+            flush();
+            for( auto p = elements.first; p != elements.last; ) {
+                size_t n = std::min<size_t>( block_size, elements.last - p );
+                f( static_cast<const T*>(p), n );
+                p += n;
+            }
+        } else {
+            UTIL_WHOLE_SEGMENT_SCOPE( table, s, segment );
+            for( auto it = segment.begin(); it != segment.end(); ++it ) {
+                scratch.push_back( *it );
+                if( scratch.size() == block_size )
+                    flush();
+            }
+        }
+    }
+    flush();
+}
+
+} // namespace util
@@ -0,0 +1,470 @@
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <cstdint>
+#include <cstring>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Hands out fixed-size byte blocks. Released blocks are kept for reuse
+// instead of being freed. Blocks may outlive the pool object.
+//
+// With a budget, every block the pool allocates is charged to it until
+// trim() frees it or the pool and all of its blocks are gone. acquire()
+// throws budget_exceeded when a new block does not fit.
+class BlockPool {
+public:
+    explicit BlockPool( size_t block_size = 64 * 1024, MemoryBudget* budget = nullptr ) :
+        _state( std::make_shared<State>() )
+    {
+        _state->block_size = block_size;
+        _state->budget = budget;
+    }
+
+    size_t block_size() const { return _state->block_size; }
+
+    // Returns a block of block_size() bytes
+    std::shared_ptr<char> acquire() {
+        char* block = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if( !_state->free.empty() ) {
+                block = _state->free.back().release();
+                _state->free.pop_back();
+            } else if( _state->budget && !_state->budget->try_charge( _state->block_size ) ) {
+                throw budget_exceeded();
+            } else {
+                ++_state->allocated;
+            }
+        }
+        if( !block )
+            block = new char[_state->block_size];
+
+        std::shared_ptr<State> state = _state;
+        return std::shared_ptr<char>( block, [state]( char* released ) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->free.emplace_back( released );
+        });
+    }
+
+    // Frees the blocks kept for reuse
+    void trim() {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        _state->trim();
+    }
+
+    // Blocks allocated by the pool, in use or kept for reuse
+    MemoryUsage memory_usage() const {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        MemoryUsage usage;
+        usage.tables = _state->free.capacity() * sizeof(std::unique_ptr<char[]>);
+        usage.elements = _state->allocated * _state->block_size;
+        return usage;
+    }
+
+private:
+    struct State {
+        ~State() { trim(); }
+
+        void trim() {
+            if( budget )
+                budget->release( free.size() * block_size );
+            allocated -= free.size();
+            free.clear();
+        }
+
+        size_t                               block_size;
+        MemoryBudget*                        budget = nullptr;
+        size_t                               allocated = 0;
+        std::mutex                           mutex;
+        std::vector<std::unique_ptr<char[]>> free;
+    };
+
+    std::shared_ptr<State> _state;
+};
+
+// LZ4-style block codec: a sequence of literal runs and back references
+// of at least 4 bytes within a 64KiB window, using the LZ4 block layout.
+//
+// This is the interface expected from any codec used with compress() and
+// decompress():
+//   - max_compressed_size(n): worst case size of compressing n bytes.
+//   - compress(src,n,dst): compresses n bytes, returns the compressed size.
+//   - decompress(src,n,dst,raw_size): restores exactly raw_size bytes,
+//     returns false if the input is corrupt.
+class Lz4Codec {
+public:
+    size_t max_compressed_size( size_t n ) const {
+        return n + n / 255 + 16;
+    }
+
+    size_t compress( const char* source, size_t n, char* destination ) const {
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(source);
+        const unsigned char* end = src + n;
+        const unsigned char* ip = src;
+        const unsigned char* anchor = src;
+        unsigned char* op = reinterpret_cast<unsigned char*>(destination);
+
+        // Matches must leave the last bytes of the input as literals
+        const unsigned char* match_limit = n > last_literals + min_match? end - last_literals : src;
+
+        std::vector<std::uint32_t> table( 1 << hash_bits );
+        while( ip + min_match <= match_limit ) {
+            std::uint32_t sequence = read32(ip);
+            std::uint32_t& entry = table[hash(sequence)];
+            const unsigned char* candidate = src + entry;
+            entry = std::uint32_t(ip - src);
+
+            if( candidate < ip && ip - candidate <= max_offset && read32(candidate) == sequence ) {
+                size_t length = min_match;
+                while( ip + length < match_limit && candidate[length] == ip[length] )
+                    length++;
+                op = write_sequence( op, anchor, ip - anchor, ip - candidate, length );
+                ip += length;
+                anchor = ip;
+            } else {
+                ip++;
+            }
+        }
+        op = write_sequence( op, anchor, end - anchor, 0, 0 );
+        return op - reinterpret_cast<unsigned char*>(destination);
+    }
+
+    bool decompress( const char* source, size_t n, char* destination, size_t raw_size ) const {
+        const unsigned char* ip = reinterpret_cast<const unsigned char*>(source);
+        const unsigned char* iend = ip + n;
+        unsigned char* dst = reinterpret_cast<unsigned char*>(destination);
+        unsigned char* op = dst;
+        unsigned char* oend = dst + raw_size;
+
+        while( ip < iend ) {
+            unsigned token = *ip++;
+
+            size_t literals = token >> 4;
+            if( literals == 15 && !read_length( ip, iend, literals ) )
+                return false;
+            if( size_t(iend - ip) < literals || size_t(oend - op) < literals )
+                return false;
+            std::memcpy( op, ip, literals );
+            ip += literals;
+            op += literals;
+
+            // The last sequence only has literals
+            if( ip == iend )
+                break;
+
+            if( iend - ip < 2 )
+                return false;
+            size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if( offset == 0 || offset > size_t(op - dst) )
+                return false;
+
+            size_t length = token & 15;
+            if( length == 15 && !read_length( ip, iend, length ) )
+                return false;
+            length += min_match;
+            if( size_t(oend - op) < length )
+                return false;
+
+            // Byte by byte: source and destination may overlap
+            const unsigned char* match = op - offset;
+            for( size_t i = 0; i < length; ++i )
+                op[i] = match[i];
+            op += length;
+        }
+        return op == oend;
+    }
+
+private:
+    static constexpr size_t    min_match = 4;
+    static constexpr size_t    last_literals = 5;
+    static constexpr ptrdiff_t max_offset = 65535;
+    static constexpr unsigned  hash_bits = 12;
+
+    static std::uint32_t read32( const unsigned char* p ) {
+        std::uint32_t value;
+        std::memcpy( &value, p, sizeof(value) );
+        return value;
+    }
+
+    static std::uint32_t hash( std::uint32_t sequence ) {
+        return (sequence * 2654435761u) >> (32 - hash_bits);
+    }
+
+    static unsigned char* write_length( unsigned char* op, size_t length ) {
+        for( ; length >= 255; length -= 255 )
+            *op++ = 255;
+        *op++ = (unsigned char)length;
+        return op;
+    }
+
+    static bool read_length( const unsigned char*& ip, const unsigned char* iend, size_t& length ) {
+        unsigned char byte;
+        do {
+            if( ip == iend )
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while( byte == 255 );
+        return true;
+    }
+
+    // Literal run followed by a match (no match when length is zero)
+    static unsigned char* write_sequence( unsigned char* op, const unsigned char* literals,
+                                          size_t num_literals, size_t offset, size_t length )
+    {
+        unsigned char* token = op++;
+        *token = (unsigned char)( std::min<size_t>(num_literals, 15) << 4 );
+        if( num_literals >= 15 )
+            op = write_length( op, num_literals - 15 );
+        std::memcpy( op, literals, num_literals );
+        op += num_literals;
+
+        if( length > 0 ) {
+            *op++ = (unsigned char)( offset & 0xFF );
+            *op++ = (unsigned char)( offset >> 8 );
+            length -= min_match;
+            *token |= (unsigned char)std::min<size_t>( length, 15 );
+            if( length >= 15 )
+                op = write_length( op, length - 15 );
+        }
+        return op;
+    }
+};
+
+namespace detail {
+
+// Every compressed block is preceded by this header (little endian)
+struct BlockHeader {
+    static constexpr size_t        size = 8;
+    static constexpr std::uint32_t stored = 0x80000000u; // Block is not compressed
+
+    static void write( char* p, std::uint32_t raw_size, std::uint32_t stored_size ) {
+        for( int i = 0; i < 4; ++i ) {
+            p[i]   = char( raw_size >> (8*i) );
+            p[4+i] = char( stored_size >> (8*i) );
+        }
+    }
+
+    static std::uint32_t read( const char* p ) {
+        std::uint32_t value = 0;
+        for( int i = 0; i < 4; ++i )
+            value |= std::uint32_t( (unsigned char)p[i] ) << (8*i);
+        return value;
+    }
+};
+
+// Reads bytes sequentially from a segment table. Reads that fit in the
+// current segment are returned in place; only reads that cross a segment
+// boundary are copied.
+template < class ContainerIt >
+class SegmentReader {
+public:
+    SegmentReader( MultiRange<ContainerIt>& ranges ) :
+        _range_it( ranges.data() ),
+        _range_end( ranges.data() + ranges.size() ),
+        _current()
+    {
+        next_segment();
+    }
+
+    bool done() {
+        return _current.first == _current.last && _range_it == _range_end;
+    }
+
+    // Returns a pointer to the next n bytes, or nullptr if input is too short
+    const char* read( size_t n, std::vector<char>& scratch ) {
+        if( size_t(_current.last - _current.first) >= n ) {
+            const char* result = _current.first;
+            _current.first += n;
+            if( _current.first == _current.last )
+                next_segment();
+            return result;
+        }
+
+        scratch.resize(n);
+        for( size_t copied = 0; copied < n; ) {
+            if( _current.first == _current.last )
+                return nullptr;
+            size_t length = std::min<size_t>( n - copied, _current.last - _current.first );
+            std::memcpy( scratch.data() + copied, _current.first, length );
+            copied += length;
+            _current.first += length;
+            if( _current.first == _current.last )
+                next_segment();
+        }
+        return scratch.data();
+    }
+
+private:
+    // Moves to the next non-empty segment
+    void next_segment() {
+        while( _range_it != _range_end ) {
+            auto segment = contiguous( *_range_it++ );
+            _current = { reinterpret_cast<const char*>(segment.first),
+                         reinterpret_cast<const char*>(segment.last) };
+            if( _current.first != _current.last )
+                return;
+        }
+        _current = { nullptr, nullptr };
+    }
+
+    range<ContainerIt>* _range_it;
+    range<ContainerIt>* _range_end;
+    range<const char*>  _current;
+};
+
+} // namespace detail
+
+// Compresses the concatenation of a table of byte segments, passing the
+// output to sink(const char* data, size_t size) as it is produced.
+//
+// Input is cut in blocks of up to block_size bytes, compressed
+// independently. Blocks are compressed straight from segment memory;
+// only the bytes of a block that spans several segments are gathered in a
+// staging buffer first.
+template < class ContainerIt, class Sink, class Codec = Lz4Codec,
+           class = std::enable_if_t<std::is_invocable<Sink&, const char*, size_t>::value> >
+void compress( MultiRange<ContainerIt> ranges, Sink&& sink,
+               const Codec& codec = Codec(), size_t block_size = 64 * 1024 )
+{
+    static_assert( is_contiguous_iterator<ContainerIt>::value, "Segments must be contiguous" );
+    static_assert( sizeof(*std::declval<ContainerIt>()) == 1, "Segments must hold bytes" );
+    UTIL_TRACE_ALGORITHM( "compress", ranges.size() );
+    using detail::BlockHeader;
+
+    std::vector<char> output( BlockHeader::size + codec.max_compressed_size(block_size) );
+    std::vector<char> staging;
+    staging.reserve( block_size );
+
+    auto emit_block = [&]( const char* data, size_t n ) {
+        size_t compressed = codec.compress( data, n, output.data() + BlockHeader::size );
+        if( compressed < n ) {
+            BlockHeader::write( output.data(), n, compressed );
+            sink( (const char*)output.data(), BlockHeader::size + compressed );
+        } else {
+            BlockHeader::write( output.data(), n, n | BlockHeader::stored );
+            sink( (const char*)output.data(), BlockHeader::size );
+            sink( data, n );
+        }
+    };
+
+    for( range<ContainerIt>* r = ranges.data(); r != ranges.data() + ranges.size(); ++r ) {
+        UTIL_WHOLE_SEGMENT_SCOPE( ranges.data(), r - ranges.data(), *r );
+        auto segment = contiguous( *r );
+        const char* first = reinterpret_cast<const char*>(segment.first);
+        const char* last = reinterpret_cast<const char*>(segment.last);
+
+        // Complete a block started on previous segments
+        if( !staging.empty() ) {
+            size_t length = std::min<size_t>( block_size - staging.size(), last - first );
+            staging.insert( staging.end(), first, first + length );
+            first += length;
+            if( staging.size() < block_size )
+                continue;
+            emit_block( staging.data(), staging.size() );
+            staging.clear();
+        }
+
+        for( ; size_t(last - first) >= block_size; first += block_size )
+            emit_block( first, block_size );
+        staging.assign( first, last );
+    }
+
+    if( !staging.empty() )
+        emit_block( staging.data(), staging.size() );
+}
+
+// Compresses into a single buffer
+template < class ContainerIt, class Codec = Lz4Codec >
+std::vector<char> compress( MultiRange<ContainerIt> ranges, const Codec& codec = Codec(),
+                            size_t block_size = 64 * 1024 )
+{
+    std::vector<char> result;
+    compress( ranges, [&]( const char* data, size_t n ) {
+        result.insert( result.end(), data, data + n );
+    }, codec, block_size );
+    return result;
+}
+
+// Output of decompress(): a chain of pooled blocks
+class DecompressedBlocks {
+public:
+    // View of the decompressed bytes. Valid while this object lives.
+    MultiRange<char*> ranges() const {
+        return MultiRange<char*>( _ranges.begin(), _ranges.end() );
+    }
+
+    size_t size() const { return _size; }
+
+    void push_back( std::shared_ptr<char> block, size_t n ) {
+        _ranges.push_back( range<char*>{ block.get(), block.get() + n } );
+        _blocks.push_back( std::move(block) );
+        _size += n;
+    }
+
+private:
+    std::vector<std::shared_ptr<char>> _blocks;
+    std::vector<range<char*>>          _ranges;
+    size_t                             _size = 0;
+};
+
+// Decompresses the output of compress(), which may itself be split in
+// arbitrary segments. Every block is restored into a block taken from
+// pool, which must be at least as large as the blocks used to compress.
+// Throws std::runtime_error if the input is corrupt.
+template < class ContainerIt, class Codec = Lz4Codec >
+DecompressedBlocks decompress( MultiRange<ContainerIt> ranges, BlockPool& pool,
+                               const Codec& codec = Codec() )
+{
+    static_assert( is_contiguous_iterator<ContainerIt>::value, "Segments must be contiguous" );
+    UTIL_TRACE_ALGORITHM( "decompress", ranges.size() );
+    using detail::BlockHeader;
+
+    DecompressedBlocks result;
+    detail::SegmentReader<ContainerIt> reader( ranges );
+    std::vector<char> scratch;
+
+    while( !reader.done() ) {
+        const char* header = reader.read( BlockHeader::size, scratch );
+        if( !header )
+            throw std::runtime_error( "decompress: truncated block header" );
+        std::uint32_t raw_size = BlockHeader::read( header );
+        std::uint32_t stored_size = BlockHeader::read( header + 4 );
+        bool stored = stored_size & BlockHeader::stored;
+        stored_size &= ~BlockHeader::stored;
+        if( raw_size > pool.block_size() )
+            throw std::runtime_error( "decompress: block larger than pool blocks" );
+        // Checked before reading, so that a corrupt size is not allocated
+        if( stored_size > codec.max_compressed_size( pool.block_size() ) )
+            throw std::runtime_error( "decompress: corrupt block" );
+
+        const char* payload = reader.read( stored_size, scratch );
+        if( !payload )
+            throw std::runtime_error( "decompress: truncated block" );
+
+        std::shared_ptr<char> block = pool.acquire();
+        if( stored ) {
+            if( stored_size != raw_size )
+                throw std::runtime_error( "decompress: corrupt block" );
+            std::memcpy( block.get(), payload, raw_size );
+        } else if( !codec.decompress( payload, stored_size, block.get(), raw_size ) ) {
+            throw std::runtime_error( "decompress: corrupt block" );
+        }
+        result.push_back( std::move(block), raw_size );
+    }
+    return result;
+}
+
+} // namespace util
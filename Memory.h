@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <atomic>
+#include <new>
+
+#include <cstddef>
+
+namespace util {
+
+// Heap memory held by a structure, as reported by memory_usage()
+struct MemoryUsage {
+    size_t tables = 0;   // Segment tables, prefix offsets and layouts
+    size_t elements = 0; // Element storage owned and resident in RAM
+
+    size_t total() const { return tables + elements; }
+
+    MemoryUsage& operator+=( const MemoryUsage& other ) {
+        tables += other.tables;
+        elements += other.elements;
+        return *this;
+    }
+};
+
+// What a structure does when an allocation does not fit its budget
+enum class OverBudget {
+    refuse,  // Throw budget_exceeded, leaving the structure unchanged
+    spill,   // Move cold data out of RAM until it fits
+    compact, // Give back unused capacity, refuse if it still does not fit
+};
+
+// Thrown when an allocation does not fit a MemoryBudget
+struct budget_exceeded : std::bad_alloc {
+    const char* what() const noexcept override { return "memory budget exceeded"; }
+};
+
+// Limit on the bytes allocated by the structures it is handed to, which
+// may be shared between several of them and between threads. Structures
+// charge it when they allocate and release it when they free; which
+// OverBudget actions they support is documented with each structure, the
+// others refuse. The budget must outlive the structures using it.
+class MemoryBudget {
+public:
+    explicit MemoryBudget( size_t limit, OverBudget action = OverBudget::refuse ) :
+        _limit( limit ),
+        _action( action )
+    {
+    }
+
+    // Not copyable, structures keep a pointer to it
+    MemoryBudget( const MemoryBudget& ) = delete;
+    MemoryBudget& operator=( const MemoryBudget& ) = delete;
+
+    // Charges bytes if they fit under the limit
+    bool try_charge( size_t bytes ) {
+        size_t used = _used.load( std::memory_order_relaxed );
+        do {
+            if( bytes > _limit || used > _limit - bytes )
+                return false;
+        } while( !_used.compare_exchange_weak( used, used + bytes, std::memory_order_relaxed ) );
+        return true;
+    }
+
+    // Charges bytes even over the limit, for memory that can not be refused
+    void force_charge( size_t bytes ) {
+        _used.fetch_add( bytes, std::memory_order_relaxed );
+    }
+
+    void release( size_t bytes ) {
+        _used.fetch_sub( bytes, std::memory_order_relaxed );
+    }
+
+    size_t used() const { return _used.load( std::memory_order_relaxed ); }
+
+    size_t limit() const { return _limit; }
+
+    OverBudget action() const { return _action; }
+
+private:
+    std::atomic<size_t> _used{0};
+    size_t              _limit;
+    OverBudget          _action;
+};
+
+} // namespace util
@@ -0,0 +1,325 @@
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Segment level instrumentation.
+//
+// When UTIL_ENABLE_METRICS is defined, the iterators and algorithms of
+// this library count, for every segment table (identified by its address)
+// and every segment, how many times it was entered, how many elements it
+// provided and, one out of every UTIL_METRICS_SAMPLE_PERIOD segments, how
+// many cycles were spent on it. Counters are kept per thread and merged
+// into a process wide registry when the thread exits or calls flush().
+// Without UTIL_ENABLE_METRICS the hooks compile to nothing.
+
+#ifndef UTIL_METRICS_SAMPLE_PERIOD
+#define UTIL_METRICS_SAMPLE_PERIOD 16
+#endif
+
+namespace util {
+namespace metrics {
+
+struct SegmentCounters {
+    std::uint64_t transitions = 0;    // Times the segment was entered
+    std::uint64_t elements = 0;       // Elements provided by the segment
+    std::uint64_t sampled_cycles = 0; // Time spent in sampled visits
+    std::uint64_t samples = 0;        // Number of sampled visits
+
+    void merge( const SegmentCounters& other ) {
+        transitions += other.transitions;
+        elements += other.elements;
+        sampled_cycles += other.sampled_cycles;
+        samples += other.samples;
+    }
+};
+
+using TableCounters = std::vector<SegmentCounters>;
+
+// Time stamp counter, or nanoseconds where not available
+inline std::uint64_t timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+#endif
+}
+
+// Process wide counters
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    void merge( const std::unordered_map<const void*,TableCounters>& tables ) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for( auto& table : tables ) {
+            TableCounters& counters = _tables[table.first];
+            if( counters.size() < table.second.size() )
+                counters.resize( table.second.size() );
+            for( size_t i = 0; i < table.second.size(); ++i )
+                counters[i].merge( table.second[i] );
+        }
+    }
+
+    // Label used for a table in the output instead of its address
+    void set_name( const void* table, std::string name ) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _names[table] = std::move(name);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tables.clear();
+    }
+
+    std::map<const void*,TableCounters> snapshot() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _tables;
+    }
+
+    std::string name( const void* table ) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _names.find(table);
+        if( it != _names.end() )
+            return it->second;
+        char address[32];
+        std::snprintf( address, sizeof(address), "%p", table );
+        return address;
+    }
+
+private:
+    Registry() = default;
+
+    std::mutex                              _mutex;
+    std::map<const void*,TableCounters>     _tables;
+    std::unordered_map<const void*,std::string> _names;
+};
+
+// Counters of the calling thread, merged into the registry on exit
+class ThreadCounters {
+public:
+    static ThreadCounters& instance() {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    ~ThreadCounters() {
+        flush();
+    }
+
+    void flush() {
+        Registry::instance().merge( _tables );
+        _tables.clear();
+        _last_table = nullptr;
+        _pending = false;
+    }
+
+    SegmentCounters& counters( const void* table, size_t index ) {
+        if( table != _last_table ) {
+            _last = &_tables[table];
+            _last_table = table;
+        }
+        if( _last->size() <= index )
+            _last->resize( index + 1 );
+        return (*_last)[index];
+    }
+
+    // A segment table iterator moved into a segment. Closes the sample
+    // of the previous segment if it was being timed.
+    void enter( const void* table, size_t index, size_t elements ) {
+        std::uint64_t now = 0;
+        if( _pending ) {
+            now = timestamp();
+            if( table == _pending_table && index == _pending_index + 1 ) {
+                SegmentCounters& previous = counters( _pending_table, _pending_index );
+                previous.sampled_cycles += now - _pending_start;
+                previous.samples++;
+            }
+            _pending = false;
+        }
+
+        SegmentCounters& current = counters( table, index );
+        current.transitions++;
+        current.elements += elements;
+
+        if( ++_visits % UTIL_METRICS_SAMPLE_PERIOD == 0 ) {
+            _pending = true;
+            _pending_table = table;
+            _pending_index = index;
+            _pending_start = now? now : timestamp();
+        }
+    }
+
+    bool sample() {
+        return ++_visits % UTIL_METRICS_SAMPLE_PERIOD == 0;
+    }
+
+private:
+    ThreadCounters() = default;
+
+    std::unordered_map<const void*,TableCounters> _tables;
+    const void*    _last_table = nullptr;
+    TableCounters* _last = nullptr;
+
+    std::uint64_t  _visits = 0;
+    bool           _pending = false;
+    const void*    _pending_table = nullptr;
+    size_t         _pending_index = 0;
+    std::uint64_t  _pending_start = 0;
+};
+
+// Accounts for a segment processed as a whole by an algorithm
+class SegmentScope {
+public:
+    SegmentScope( const void* table, size_t index, size_t elements ) :
+        _table( table ),
+        _index( index ),
+        _start( 0 )
+    {
+        ThreadCounters& thread = ThreadCounters::instance();
+        SegmentCounters& counters = thread.counters( table, index );
+        counters.transitions++;
+        counters.elements += elements;
+        if( thread.sample() )
+            _start = timestamp();
+    }
+
+    ~SegmentScope() {
+        if( _start ) {
+            std::uint64_t elapsed = timestamp() - _start;
+            SegmentCounters& counters = ThreadCounters::instance().counters( _table, _index );
+            counters.sampled_cycles += elapsed;
+            counters.samples++;
+        }
+    }
+
+private:
+    const void*   _table;
+    size_t        _index;
+    std::uint64_t _start;
+};
+
+// Escapes a label for JSON and Prometheus output
+inline std::string quoted( const std::string& text ) {
+    std::string result("\"");
+    for( char c : text ) {
+        if( c == '"' || c == '\\' )
+            result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+inline void set_name( const void* table, std::string name ) {
+    Registry::instance().set_name( table, std::move(name) );
+}
+
+// Merges the counters of the calling thread into the registry
+inline void flush() {
+    ThreadCounters::instance().flush();
+}
+
+// Registry contents as JSON
+inline std::string to_json() {
+    flush();
+    Registry& registry = Registry::instance();
+    std::ostringstream out;
+    out << "{\"ranges\":[";
+    const char* range_separator = "";
+    for( auto& table : registry.snapshot() ) {
+        out << range_separator << "{\"range\":" << quoted(registry.name(table.first)) << ",\"segments\":[";
+        const char* separator = "";
+        for( size_t i = 0; i < table.second.size(); ++i ) {
+            const SegmentCounters& c = table.second[i];
+            out << separator << "{\"index\":" << i
+                << ",\"transitions\":" << c.transitions
+                << ",\"elements\":" << c.elements
+                << ",\"sampled_cycles\":" << c.sampled_cycles
+                << ",\"samples\":" << c.samples << "}";
+            separator = ",";
+        }
+        out << "]}";
+        range_separator = ",";
+    }
+    out << "]}\n";
+    return out.str();
+}
+
+// Registry contents in Prometheus text exposition format
+inline std::string to_prometheus() {
+    flush();
+    Registry& registry = Registry::instance();
+    auto tables = registry.snapshot();
+
+    struct Metric {
+        const char* name;
+        const char* help;
+        std::uint64_t SegmentCounters::* field;
+    };
+    const Metric metrics[] = {
+        { "multi_iterators_segment_transitions_total", "Times a segment was entered", &SegmentCounters::transitions },
+        { "multi_iterators_segment_elements_total", "Elements provided by a segment", &SegmentCounters::elements },
+        { "multi_iterators_segment_sampled_cycles_total", "Cycles spent in sampled segment visits", &SegmentCounters::sampled_cycles },
+        { "multi_iterators_segment_samples_total", "Sampled segment visits", &SegmentCounters::samples },
+    };
+
+    std::ostringstream out;
+    for( const Metric& metric : metrics ) {
+        out << "# HELP " << metric.name << " " << metric.help << "\n";
+        out << "# TYPE " << metric.name << " counter\n";
+        for( auto& table : tables ) {
+            std::string name = quoted(registry.name(table.first));
+            for( size_t i = 0; i < table.second.size(); ++i ) {
+                out << metric.name << "{range=" << name << ",segment=\"" << i << "\"} "
+                    << table.second[i].*metric.field << "\n";
+            }
+        }
+    }
+    return out.str();
+}
+
+inline bool write_file( const std::string& path, const std::string& contents ) {
+    std::FILE* file = std::fopen( path.c_str(), "w" );
+    if( !file )
+        return false;
+    bool ok = std::fwrite( contents.data(), 1, contents.size(), file ) == contents.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+inline bool write_json( const std::string& path ) {
+    return write_file( path, to_json() );
+}
+
+inline bool write_prometheus( const std::string& path ) {
+    return write_file( path, to_prometheus() );
+}
+
+} // namespace metrics
+} // namespace util
+
+#if defined(UTIL_ENABLE_METRICS)
+#define UTIL_METRICS_SEGMENT_ENTER(table, index, elements) \
+    ::util::metrics::ThreadCounters::instance().enter( (table), (index), (elements) )
+#define UTIL_METRICS_SEGMENT_SCOPE(table, index, elements) \
+    ::util::metrics::SegmentScope util_metrics_segment_scope( (table), (index), (elements) )
+#elif !defined(UTIL_METRICS_SEGMENT_ENTER)
+#define UTIL_METRICS_SEGMENT_ENTER(table, index, elements) ((void)0)
+#define UTIL_METRICS_SEGMENT_SCOPE(table, index, elements) ((void)0)
+#endif
@@ -2,21 +2,118 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <iterator>
 #include <memory>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 #include <cassert>
+#include <cstdint>
+
+#include "Memory.h"
+#include "Range.h"
+#include "Tracing.h"
+
+#if defined(UTIL_ENABLE_METRICS)
+#include "Metrics.h"
+#elif !defined(UTIL_METRICS_SEGMENT_ENTER)
+#define UTIL_METRICS_SEGMENT_ENTER(table, index, elements) ((void)0)
+#define UTIL_METRICS_SEGMENT_SCOPE(table, index, elements) ((void)0)
+#endif
+
+// Instrumentation of a segment, or a slice of one, that an algorithm
+// processes as a whole. elements must be cheap to compute.
+#define UTIL_SEGMENT_SCOPE(table, index, elements) \
+    UTIL_METRICS_SEGMENT_SCOPE(table, index, elements); \
+    UTIL_TRACE_SEGMENT_SCOPE(table, index, elements)
+
+// Same for the whole segment r of any iterator type. Its length is only
+// counted when metrics are enabled, and only traced if it takes constant
+// time, so that probes stay free while no tracer is attached.
+#define UTIL_WHOLE_SEGMENT_SCOPE(table, index, r) \
+    UTIL_METRICS_SEGMENT_SCOPE(table, index, std::distance((r).begin(), (r).end())); \
+    UTIL_TRACE_SEGMENT_SCOPE(table, index, ::util::detail::traced_length(r))
 
 namespace util {
 
-template < class Iterator >
-struct range {
-    Iterator first;
-    Iterator last;
+namespace detail {
 
-    Iterator begin() { return first; }
-    Iterator end()   { return last; }
+// Length of a range for tracing, -1 if it is not constant time
+template < class It >
+std::ptrdiff_t traced_length( const range<It>& r ) {
+    using category = typename std::iterator_traits<It>::iterator_category;
+    if constexpr( std::is_base_of<std::random_access_iterator_tag, category>::value )
+        return std::distance( r.first, r.last );
+    else
+        return -1;
+}
+
+// Segment holding the element at position, given the offsets of num_ranges
+// segments, searched from segment hint outwards: steps doubling in size
+// bracket it, then a binary search inside the bracket finds it. Costs
+// O(log d) for a segment d segments away from hint. Empty segments are
+// skipped, as with std::upper_bound over all the offsets.
+inline size_t gallop_segment( const size_t* offsets, size_t num_ranges, size_t hint, size_t position ) {
+    assert( position < offsets[num_ranges] && hint < num_ranges );
+    size_t lo = hint;
+    size_t hi = hint;
+    size_t step = 1;
+    if( offsets[hint] <= position ) {
+        while( lo + step < num_ranges && offsets[lo + step] <= position ) {
+            lo += step;
+            step *= 2;
+        }
+        hi = std::min( lo + step, num_ranges );
+    } else {
+        lo = hi - 1;
+        while( offsets[lo] > position ) {
+            hi = lo;
+            step *= 2;
+            lo = hi >= step? hi - step : 0;
+        }
+    }
+    return std::upper_bound( offsets + lo + 1, offsets + hi, position ) - offsets - 1;
+}
+
+} // namespace detail
+
+// Segments shorter than this are better gathered with their neighbours
+// than processed one at a time
+constexpr size_t tiny_segment_size = 16;
+
+// How bulk algorithms should walk a MultiRange
+enum class SegmentStrategy {
+    elementwise, // Segments are not contiguous: visit elements one by one
+    per_segment, // Segments are long enough to be processed in place
+    gather,      // Most segments are tiny: gather them in a scratch buffer
+};
+
+// Segment size distribution, computed when a MultiRange is built
+struct SegmentProfile {
+    size_t          elements = 0;      // Random access segments only
+    size_t          tiny_segments = 0; // Random access segments only
+    SegmentStrategy strategy = SegmentStrategy::elementwise;
+};
+
+#ifndef UTIL_NON_TEMPORAL_BYTES
+#define UTIL_NON_TEMPORAL_BYTES (1 << 20)
+#endif
+
+// Size class of a contiguous segment
+enum class LengthClass : std::uint8_t {
+    tiny,  // Fewer than tiny_segment_size elements
+    small, // Under 4 KiB
+    large, // Under UTIL_NON_TEMPORAL_BYTES
+    huge,  // Worth writing with non-temporal stores
+};
+
+// Memory layout of a contiguous segment, so that kernels can peel to an
+// aligned boundary and pick their loads and stores once per segment
+struct SegmentLayout {
+    std::uint8_t alignment; // Alignment of the first element in bytes, up to 64
+    LengthClass  length;
 };
 
 template < class ContainerIt >
@@ -32,9 +129,28 @@ public:
     template < class InputIt >
     MultiRange( InputIt begin, InputIt end ) :
         _num_ranges(std::distance(begin,end)),
-        _ranges(new range<ContainerIt>[_num_ranges], deleter)
+        _ranges(new range<ContainerIt>[_num_ranges], deleter<range<ContainerIt>>)
     {
         std::copy_n( begin, size(), data() );
+        if constexpr( random_access ) {
+            // Position of the first element of every segment
+            _offsets.reset( new size_t[_num_ranges + 1], deleter<size_t> );
+            _offsets.get()[0] = 0;
+            for( size_t i = 0; i < _num_ranges; ++i ) {
+                size_t length = std::distance( data()[i].first, data()[i].last );
+                _offsets.get()[i+1] = _offsets.get()[i] + length;
+                _profile.tiny_segments += length < tiny_segment_size;
+            }
+            _profile.elements = _offsets.get()[_num_ranges];
+            if( is_contiguous_iterator<ContainerIt>::value )
+                _profile.strategy = _profile.tiny_segments * 2 > _num_ranges? SegmentStrategy::gather
+                                                                              : SegmentStrategy::per_segment;
+        }
+        if constexpr( is_contiguous_iterator<ContainerIt>::value ) {
+            _layouts.reset( new SegmentLayout[_num_ranges], deleter<SegmentLayout> );
+            for( size_t i = 0; i < _num_ranges; ++i )
+                _layouts.get()[i] = make_layout( data()[i] );
+        }
     }
 
     // Copyable
@@ -42,39 +158,112 @@ public:
     // Moveable
     MultiRange( MultiRange&& ) = default;
 
-    iterator begin();
-    iterator end();
+    iterator begin() const;
+    iterator end() const;
+
+    // Iterator to element of a segment. The end of a segment stands for
+    // the first element of the next non-empty one.
+    iterator make_iterator( size_t segment, ContainerIt element ) const {
+        return iterator( data(), data() + size(), _offsets.get(), data() + segment, element );
+    }
+
+    range<ContainerIt>* data() const { return _ranges.get(); }
+
+    // Position of the first element of every segment, followed by the
+    // number of elements (random access segments only)
+    const size_t* offsets() const {
+        static_assert( random_access, "Offsets need random access segments" );
+        return _offsets.get();
+    }
+
+    // Layout of a segment (contiguous segments only)
+    const SegmentLayout& layout( size_t segment ) const {
+        static_assert( is_contiguous_iterator<ContainerIt>::value, "Segments are not contiguous" );
+        return _layouts.get()[segment];
+    }
 
-    range<ContainerIt>* data() { return _ranges.get(); }
+    size_t size() const { return _num_ranges; }
 
-    size_t size() { return _num_ranges; }
+    const SegmentProfile& profile() const { return _profile; }
+
+    // Tables of this MultiRange, which copies share. The segments are
+    // not owned and not counted.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.tables = _num_ranges * sizeof(range<ContainerIt>);
+        if( _offsets )
+            usage.tables += (_num_ranges + 1) * sizeof(size_t);
+        if( _layouts )
+            usage.tables += _num_ranges * sizeof(SegmentLayout);
+        return usage;
+    }
 
 private:
-    static void deleter( range<ContainerIt>* ptr ) {
+    static constexpr bool random_access = std::is_base_of<std::random_access_iterator_tag,
+            typename std::iterator_traits<ContainerIt>::iterator_category>::value;
+
+    template < class T >
+    static void deleter( T* ptr ) {
         delete[] ptr;
     }
 
+    static SegmentLayout make_layout( range<ContainerIt> segment ) {
+        auto elements = contiguous( segment );
+        size_t length = elements.last - elements.first;
+        size_t bytes = length * sizeof(*elements.first);
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>( elements.first );
+        std::uintptr_t alignment = address? address & -address : 64;
+        return {
+            std::uint8_t( std::min<std::uintptr_t>( alignment, 64 ) ),
+            length < tiny_segment_size? LengthClass::tiny
+          : bytes < 4096? LengthClass::small
+          : bytes < UTIL_NON_TEMPORAL_BYTES? LengthClass::large
+          : LengthClass::huge
+        };
+    }
+
     size_t                                _num_ranges;
     std::shared_ptr<range<ContainerIt>> _ranges;
+    std::shared_ptr<size_t>              _offsets; // Only with random access segments
+    std::shared_ptr<SegmentLayout>       _layouts; // Only with contiguous segments
+    SegmentProfile                        _profile;
 };
 
+// Iterator over the elements of a MultiRange. It is as strong as the
+// iterators of the segments, up to random access. Empty segments are
+// skipped: an iterator always refers to an element, unless it is end().
 template < class ContainerIt >
 class MultiRange<ContainerIt>::iterator {
 private:
     using ElementIt = decltype(std::declval<range<ContainerIt>>().begin());
+    using element_category = typename std::iterator_traits<ElementIt>::iterator_category;
+
+    static constexpr bool bidirectional = std::is_base_of<std::bidirectional_iterator_tag, element_category>::value;
 
 public:
-    using value_type      = typename std::iterator_traits<ElementIt>::value_type;
-    using reference_type  = value_type&;
-    using pointer_type    = value_type*;
-    using difference_type = std::ptrdiff_t;
+    using value_type        = typename std::iterator_traits<ElementIt>::value_type;
+    using reference         = typename std::iterator_traits<ElementIt>::reference;
+    using pointer           = typename std::iterator_traits<ElementIt>::pointer;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::conditional_t<random_access, std::random_access_iterator_tag,
+                              std::conditional_t<bidirectional, std::bidirectional_iterator_tag,
+                              std::conditional_t<std::is_base_of<std::forward_iterator_tag, element_category>::value,
+                                                 std::forward_iterator_tag, std::input_iterator_tag>>>;
+    using iterator_concept  = iterator_category;
 
     iterator() = default;
 
-    iterator( range<ContainerIt>* range, ElementIt element ) :
+    iterator( range<ContainerIt>* table, range<ContainerIt>* table_end, const size_t* offsets,
+              range<ContainerIt>* range, ElementIt element ) :
+        _table( table ),
         _range_it( range ),
-        _element_it( element )
+        _range_end( table_end ),
+        _offsets( offsets ),
+        _element_it( element ),
+        _segment_end( range != table_end? range->end() : ElementIt() )
     {
+        if( _range_it != _range_end && _element_it == _segment_end )
+            next_segment();
     }
 
     // Copyable
@@ -89,11 +278,10 @@ public:
 
     // Pre increment
     iterator& operator++() {
-        if( _element_it == _range_it->end() ) {
-            _range_it++;
-            _element_it = _range_it->begin();
-        } else {
-            _element_it++;
+        if( ++_element_it == _segment_end ) {
+            range<ContainerIt>* previous = _range_it;
+            next_segment();
+            entered_segment( previous );
         }
         return *this;
     }
@@ -105,62 +293,380 @@ public:
         return tmp;
     }
 
+    // Pre decrement
+    template < bool B = bidirectional, class = std::enable_if_t<B> >
+    iterator& operator--() {
+        if( _range_it == _range_end || _element_it == _range_it->begin() ) {
+            range<ContainerIt>* previous = _range_it;
+            do {
+                --_range_it;
+            } while( _range_it->begin() == _range_it->end() );
+            _segment_end = _range_it->end();
+            _element_it = std::prev( _segment_end );
+            entered_segment( previous );
+        } else {
+            --_element_it;
+        }
+        return *this;
+    }
+
+    // Post decrement
+    template < bool B = bidirectional, class = std::enable_if_t<B> >
+    iterator operator--(int) {
+        iterator tmp(*this);
+        --(*this);
+        return tmp;
+    }
+
     // De-reference
-    reference_type operator*() {
-        if( _element_it == _range_it->end() )
-            _element_it = (++_range_it)->begin();
+    reference operator*() const {
         return *_element_it;
     }
 
     // De-reference
-    ElementIt operator->() {
+    ElementIt operator->() const {
         return _element_it;
     }
 
+    // Random access
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    iterator& operator+=( difference_type n ) {
+        if( _range_it != _range_end ) {
+            // Stays in the current segment
+            difference_type offset = (_element_it - _range_it->begin()) + n;
+            if( offset >= 0 && offset < _segment_end - _range_it->begin() ) {
+                _element_it = _range_it->begin() + offset;
+                return *this;
+            }
+        }
+        seek( position() + n );
+        return *this;
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    iterator& operator-=( difference_type n ) {
+        return *this += -n;
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    iterator operator+( difference_type n ) const {
+        iterator tmp(*this);
+        return tmp += n;
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    friend iterator operator+( difference_type n, const iterator& it ) {
+        return it + n;
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    iterator operator-( difference_type n ) const {
+        iterator tmp(*this);
+        return tmp += -n;
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    difference_type operator-( const iterator& other ) const {
+        return difference_type(position()) - difference_type(other.position());
+    }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    reference operator[]( difference_type n ) const {
+        return *(*this + n);
+    }
+
+    // Position of the element in the concatenation (random access only)
+    size_t position() const {
+        static_assert( random_access, "Positions need random access segments" );
+        if( _range_it == _range_end )
+            return _offsets[_range_end - _table];
+        return _offsets[_range_it - _table] + (_element_it - _range_it->begin());
+    }
+
+    // Longest run of up to max_n elements starting here that does not
+    // cross a segment, and moves past it. The run holds a single element
+    // when the segment is not contiguous. Must not be called on end().
+    range<pointer> next_batch( size_t max_n ) {
+        assert( _range_it != _range_end );
+        size_t n = std::min<size_t>( max_n, 1 );
+        if constexpr( is_contiguous_iterator<ElementIt>::value )
+            n = std::min<size_t>( max_n, std::distance(_element_it, _segment_end) );
+        pointer first = std::addressof(*_element_it);
+        std::advance( _element_it, n );
+        if( _element_it == _segment_end ) {
+            range<ContainerIt>* previous = _range_it;
+            next_segment();
+            entered_segment( previous );
+        }
+        return { first, first + n };
+    }
+
+    bool operator==( const iterator& other ) const {
+        return _range_it == other._range_it
+            && _element_it == other._element_it;
+    }
+
     bool operator!=( const iterator& other ) const {
-        return _range_it != other._range_it
-            || _element_it != other._element_it;
+        return !(*this == other);
     }
 
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    bool operator<( const iterator& other ) const { return position() < other.position(); }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    bool operator>( const iterator& other ) const { return other < *this; }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    bool operator<=( const iterator& other ) const { return !(other < *this); }
+
+    template < bool B = random_access, class = std::enable_if_t<B> >
+    bool operator>=( const iterator& other ) const { return !(*this < other); }
+
 private:
-    range<ContainerIt>* _range_it;
-    ElementIt           _element_it;
+    // Moves to the first element of the next non-empty segment, or to end()
+    void next_segment() {
+        do {
+            ++_range_it;
+        } while( _range_it != _range_end && _range_it->begin() == _range_it->end() );
+        _element_it = _range_it != _range_end? _range_it->begin() : ElementIt();
+        _segment_end = _range_it != _range_end? _range_it->end() : ElementIt();
+    }
+
+    // Moves to the element at a position of the concatenation
+    void seek( size_t position ) {
+        range<ContainerIt>* previous = _range_it;
+        const size_t num_ranges = _range_end - _table;
+        assert( position <= _offsets[num_ranges] );
+        if( position == _offsets[num_ranges] ) {
+            _range_it = _range_end;
+            _element_it = ElementIt();
+            _segment_end = ElementIt();
+        } else {
+            size_t hint = std::min<size_t>( _range_it - _table, num_ranges - 1 );
+            size_t s = detail::gallop_segment( _offsets, num_ranges, hint, position );
+            _range_it = _table + s;
+            _element_it = _range_it->begin() + (position - _offsets[s]);
+            _segment_end = _range_it->end();
+        }
+        if( _range_it != previous )
+            entered_segment( previous );
+    }
+
+    void entered_segment( range<ContainerIt>* previous ) {
+        if( previous != _range_end )
+            UTIL_TRACE_SEGMENT_EXIT( _table, previous - _table, detail::traced_length(*previous) );
+        if( _range_it != _range_end ) {
+            UTIL_TRACE_SEGMENT_ENTER( _table, _range_it - _table, detail::traced_length(*_range_it) );
+            UTIL_METRICS_SEGMENT_ENTER( _table, _range_it - _table,
+                                        std::distance(_range_it->begin(), _range_it->end()) );
+        }
+        (void)previous;
+    }
+
+    range<ContainerIt>* _table = nullptr; // Identifies the MultiRange, and indexes _offsets
+    range<ContainerIt>* _range_it = nullptr;
+    range<ContainerIt>* _range_end = nullptr;
+    const size_t*       _offsets = nullptr; // Only with random access segments
+    ElementIt           _element_it{};
+    ElementIt           _segment_end{}; // Saves a table access per element
 };
 
 template < class ContainerIt >
 inline
-typename MultiRange<ContainerIt>::iterator MultiRange<ContainerIt>::begin()
+typename MultiRange<ContainerIt>::iterator MultiRange<ContainerIt>::begin() const
 {
-    using ElementIt = decltype( data()->begin() );
-    range<ContainerIt>* first = data();
-    ElementIt element = first? first->begin() : ElementIt();
-    return {first, element};
+    range<ContainerIt>* table = data();
+    size_t first = 0;
+    while( first < size() && table[first].begin() == table[first].end() )
+        ++first;
+    if( first == size() )
+        return end();
+    UTIL_TRACE_SEGMENT_ENTER( table, first, detail::traced_length(table[first]) );
+    UTIL_METRICS_SEGMENT_ENTER( table, first, std::distance(table[first].begin(), table[first].end()) );
+    return make_iterator( first, table[first].begin() );
 }
 
 template < class ContainerIt >
 inline
-typename MultiRange<ContainerIt>::iterator MultiRange<ContainerIt>::end()
+typename MultiRange<ContainerIt>::iterator MultiRange<ContainerIt>::end() const
 {
-    if( size() > 0 ) {
-        range<ContainerIt>* last = data() + (size() -1);
-        return iterator( last, last->end() );
+    return make_iterator( size(), ContainerIt() );
+}
+
+// Random access into a MultiRange for lookups that fall near each other,
+// such as sorted probes. The cursor remembers the segment of the last
+// lookup and gallops from there: an element d segments away is found in
+// O(log d) rather than O(log n) for n segments.
+template < class ContainerIt >
+class FingerCursor {
+public:
+    using iterator  = typename MultiRange<ContainerIt>::iterator;
+    using reference = typename iterator::reference;
+
+    explicit FingerCursor( MultiRange<ContainerIt> ranges ) :
+        _ranges( std::move(ranges) )
+    {
+    }
+
+    // Segment holding the element at position, which becomes the finger
+    size_t segment( size_t position ) {
+        _segment = detail::gallop_segment( _ranges.offsets(), _ranges.size(), _segment, position );
+        return _segment;
+    }
+
+    reference operator[]( size_t position ) {
+        size_t s = segment( position );
+        return *(_ranges.data()[s].begin() + (position - _ranges.offsets()[s]));
+    }
+
+    // Iterator to the element at position, or end() past the last one
+    iterator at( size_t position ) {
+        if( position == _ranges.offsets()[_ranges.size()] )
+            return _ranges.end();
+        size_t s = segment( position );
+        return _ranges.make_iterator( s, _ranges.data()[s].begin() + (position - _ranges.offsets()[s]) );
+    }
+
+private:
+    MultiRange<ContainerIt> _ranges;
+    size_t                  _segment = 0;
+};
+
+// Customization point for containers made of several contiguous chunks
+// (chunked vectors, buffer chains, ropes...). A specialization provides
+//
+//   using iterator = ...;  // Iterator over the elements of one chunk
+//   template < class F >
+//   static void for_each_segment( Container& c, F f ); // f(first, last) for every chunk, in order
+//
+// and iterate_over() then adds every chunk as its own segment instead of
+// walking the container through its own iterators. Specialize for
+// const Container too if constant containers are iterated.
+template < class Container >
+struct segment_traits {};
+
+template < class Container, class = void >
+struct is_segmented : std::false_type {};
+
+template < class Container >
+struct is_segmented<Container, std::void_t<typename segment_traits<Container>::iterator>> : std::true_type {};
+
+namespace detail {
+
+template < class Container, bool = is_segmented<Container>::value >
+struct segment_iterator {
+    using type = decltype(std::begin(std::declval<Container&>()));
+};
+
+template < class Container >
+struct segment_iterator<Container,true> {
+    using type = typename segment_traits<Container>::iterator;
+};
+
+// Plain pointer that iterators over contiguous elements of the same type
+// can all be lowered to
+template < class It, class... Its >
+struct lowered_pointer {
+    template < class I >
+    using element = std::remove_reference_t<typename std::iterator_traits<I>::reference>;
+
+    static constexpr bool value =
+        (is_contiguous_iterator<It>::value && ... && is_contiguous_iterator<Its>::value)
+     && (std::is_same<std::remove_cv_t<element<It>>, std::remove_cv_t<element<Its>>>::value && ...);
+
+    using type = std::conditional_t<(std::is_const<element<It>>::value || ... || std::is_const<element<Its>>::value),
+                                    const std::remove_cv_t<element<It>>*,
+                                    std::remove_cv_t<element<It>>*>;
+};
+
+// Iterator type of a table mixing segments of the given iterator types:
+// their common type, or else a plain pointer when they all refer to
+// contiguous elements of the same type (such as an array, a std::vector
+// and a std::array).
+template < class Void, class... It >
+struct table_iterator {
+    static_assert( lowered_pointer<It...>::value,
+                   "Iterators have no common type and can not be lowered to pointers" );
+    using type = typename lowered_pointer<It...>::type;
+};
+
+template < class... It >
+struct table_iterator<std::void_t<std::common_type_t<It...>>, It...> {
+    using type = std::common_type_t<It...>;
+};
+
+template < class... It >
+using table_iterator_t = typename table_iterator<void, It...>::type;
+
+// Segment of a table from a pair of iterators of possibly another type
+template < class ContainerIt, class It >
+range<ContainerIt> make_segment( It first, It last ) {
+    if constexpr( std::is_convertible<It, ContainerIt>::value ) {
+        return { first, last };
     } else {
-        return iterator();
+        auto elements = contiguous( range<It>{ first, last } );
+        return { elements.first, elements.last };
     }
 }
 
-template < class Container >
-auto iterate_over2( std::initializer_list<Container> containers ) {
-    using ContainerIt = decltype(std::begin(containers));
-    return MultiRange<ContainerIt>(std::begin(containers), std::end(containers));
+template < class ContainerIt, class Container >
+void append_segments( std::vector<range<ContainerIt>>& ranges, Container& container ) {
+    if constexpr( is_segmented<Container>::value ) {
+        segment_traits<Container>::for_each_segment( container, [&]( auto first, auto last ) {
+            ranges.push_back( make_segment<ContainerIt>( first, last ) );
+        });
+    } else {
+        ranges.push_back( make_segment<ContainerIt>( std::begin(container), std::end(container) ) );
+    }
 }
 
+// Container an element of iterate_over_all() refers to
+template < class Container >
+Container& referenced( Container* container ) { return *container; }
+
+template < class Container >
+Container& referenced( std::reference_wrapper<Container> container ) { return container.get(); }
+
+template < class Container >
+Container& referenced( Container& container ) { return container; }
+
+} // namespace detail
+
 template < class... T >
 auto iterate_over( T&... containers ) {
-    using ContainerIt = std::common_type_t<decltype(std::begin(containers))...>;
-    return MultiRange<ContainerIt>(
-            {range<ContainerIt>{std::begin(containers), std::end(containers)}...}
-        );
+    using ContainerIt = detail::table_iterator_t<typename detail::segment_iterator<T>::type...>;
+    if constexpr( (is_segmented<T>::value || ...) ) {
+        std::vector<range<ContainerIt>> ranges;
+        (detail::append_segments( ranges, containers ), ...);
+        return MultiRange<ContainerIt>( ranges.begin(), ranges.end() );
+    } else {
+        return MultiRange<ContainerIt>(
+                {detail::make_segment<ContainerIt>(std::begin(containers), std::end(containers))...}
+            );
+    }
+}
+
+// Concatenates a number of containers only known at run time. containers
+// is any range of pointers to containers, std::reference_wrappers or the
+// containers themselves; the table refers to the containers in place and
+// no element is copied. The containers must outlive the MultiRange.
+//
+//   std::vector<std::vector<int>*> buffers = ...;
+//   for( int v : util::iterate_over_all(buffers) ) ...
+template < class Containers >
+auto iterate_over_all( Containers&& containers ) {
+    using Container = std::remove_reference_t<decltype(detail::referenced(*std::begin(containers)))>;
+    using ContainerIt = typename detail::segment_iterator<Container>::type;
+    std::vector<range<ContainerIt>> ranges;
+    ranges.reserve( std::distance(std::begin(containers), std::end(containers)) );
+    for( auto&& container : containers )
+        detail::append_segments( ranges, detail::referenced(container) );
+    return MultiRange<ContainerIt>( ranges.begin(), ranges.end() );
+}
+
+template < class Container >
+auto iterate_over_all( std::initializer_list<Container*> containers ) {
+    return iterate_over_all<std::initializer_list<Container*>&>( containers );
 }
 
 } // namespace util
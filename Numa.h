@@ -0,0 +1,227 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// CPUs of each NUMA node this process may run on
+struct NumaTopology {
+    std::vector<std::vector<int>> cpus; // Indexed by node
+
+    size_t num_nodes() const { return cpus.size(); }
+
+    // Reads the topology from sysfs. Falls back to a single node holding
+    // every CPU when NUMA information is not available.
+    static NumaTopology detect();
+};
+
+namespace detail {
+
+// Parses a sysfs CPU list such as "0-3,8,10-11"
+inline std::vector<int> parse_cpu_list( const std::string& list ) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string item;
+    while( std::getline( stream, item, ',' ) ) {
+        if( item.empty() || item == "\n" )
+            continue;
+        size_t dash = item.find('-');
+        int first = std::stoi( item.substr(0, dash) );
+        int last = dash == std::string::npos? first : std::stoi( item.substr(dash + 1) );
+        for( int cpu = first; cpu <= last; ++cpu )
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+} // namespace detail
+
+inline NumaTopology NumaTopology::detect() {
+    NumaTopology topology;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    bool have_affinity = sched_getaffinity( 0, sizeof(allowed), &allowed ) == 0;
+
+    for( int node = 0; ; ++node ) {
+        std::ifstream file( "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist" );
+        if( !file )
+            break;
+        std::string list;
+        std::getline( file, list );
+        std::vector<int> cpus;
+        for( int cpu : detail::parse_cpu_list(list) ) {
+            if( !have_affinity || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) )
+                cpus.push_back(cpu);
+        }
+        topology.cpus.push_back( std::move(cpus) );
+    }
+
+    // Nodes without usable CPUs can still hold memory, keep them so that
+    // node numbers stay valid, but make sure there is some CPU somewhere
+    bool any = false;
+    for( auto& cpus : topology.cpus )
+        any = any || !cpus.empty();
+    if( any )
+        return topology;
+    topology.cpus.clear();
+#endif
+
+    std::vector<int> cpus( std::max( 1u, std::thread::hardware_concurrency() ) );
+    for( size_t cpu = 0; cpu < cpus.size(); ++cpu )
+        cpus[cpu] = int(cpu);
+    topology.cpus.push_back( std::move(cpus) );
+    return topology;
+}
+
+// NUMA node where the page holding address resides, or -1 if unknown
+// (not yet touched, not supported by the system...)
+inline int home_node( const void* address ) {
+#if defined(__linux__) && defined(SYS_move_pages)
+    // With no target nodes, move_pages only reports where pages are
+    void* page = const_cast<void*>(address);
+    int status = -1;
+    if( syscall( SYS_move_pages, 0, 1ul, &page, nullptr, &status, 0 ) == 0 && status >= 0 )
+        return status;
+#endif
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    const int MPOL_F_NODE = 1, MPOL_F_ADDR = 2;
+    int node = -1;
+    if( syscall( SYS_get_mempolicy, &node, nullptr, 0ul, address, MPOL_F_NODE | MPOL_F_ADDR ) == 0 )
+        return node;
+#endif
+    (void)address;
+    return -1;
+}
+
+// Home node of the first element of every segment, -1 where unknown or
+// when segments are not contiguous
+template < class ContainerIt >
+std::vector<int> segment_home_nodes( MultiRange<ContainerIt> ranges ) {
+    std::vector<int> nodes( ranges.size(), -1 );
+    if constexpr( is_contiguous_iterator<ContainerIt>::value ) {
+        for( size_t i = 0; i < ranges.size(); ++i ) {
+            range<ContainerIt>& r = ranges.data()[i];
+            if( r.first != r.last )
+                nodes[i] = home_node( std::addressof(*r.first) );
+        }
+    }
+    return nodes;
+}
+
+// Processes whole segments in parallel, preferring CPUs of the NUMA node
+// where each segment lives. There is one worker per usable CPU, bound to
+// the CPUs of its node. Workers take segments of their own node first and
+// only steal from other nodes when their own node runs out of work.
+// On single node machines this is a plain parallel loop over segments.
+class NumaExecutor {
+public:
+    NumaExecutor() :
+        _topology( NumaTopology::detect() )
+    {
+    }
+
+    explicit NumaExecutor( NumaTopology topology ) :
+        _topology( std::move(topology) )
+    {
+    }
+
+    const NumaTopology& topology() const { return _topology; }
+
+    // Calls f(index, segment) once for every segment. nodes gives the home
+    // node of each segment; when empty, it is queried with
+    // segment_home_nodes(). Segments with an unknown (or out of range)
+    // node are spread over all nodes.
+    template < class ContainerIt, class F >
+    void for_each_segment( MultiRange<ContainerIt> ranges, F f, std::vector<int> nodes = {} );
+
+private:
+    NumaTopology _topology;
+};
+
+template < class ContainerIt, class F >
+void NumaExecutor::for_each_segment( MultiRange<ContainerIt> ranges, F f, std::vector<int> nodes )
+{
+    UTIL_TRACE_ALGORITHM( "numa_for_each_segment", ranges.size() );
+    const size_t num_nodes = _topology.num_nodes();
+    if( nodes.empty() && num_nodes > 1 )
+        nodes = segment_home_nodes( ranges );
+
+    // Work queue of each node
+    std::vector<std::vector<size_t>> queues( num_nodes );
+    size_t spread = 0;
+    for( size_t i = 0; i < ranges.size(); ++i ) {
+        int node = i < nodes.size()? nodes[i] : -1;
+        if( node < 0 || size_t(node) >= num_nodes )
+            node = int( spread++ % num_nodes );
+        queues[node].push_back(i);
+    }
+    std::vector<std::atomic<size_t>> heads( num_nodes );
+    for( auto& head : heads )
+        head = 0;
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    range<ContainerIt>* table = ranges.data();
+
+    auto work = [&]( size_t home ) {
+        // Own node first, then the others
+        for( size_t k = 0; k < num_nodes; ++k ) {
+            size_t node = (home + k) % num_nodes;
+            for( size_t next = heads[node]++; next < queues[node].size(); next = heads[node]++ ) {
+                size_t i = queues[node][next];
+                try {
+                    UTIL_WHOLE_SEGMENT_SCOPE( table, i, table[i] );
+                    f( i, table[i] );
+                } catch( ... ) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if( !error )
+                        error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for( size_t node = 0; node < num_nodes; ++node ) {
+        for( size_t c = 0; c < _topology.cpus[node].size(); ++c ) {
+            if( node == 0 && c == 0 )
+                continue; // The calling thread works for node 0
+            threads.emplace_back( [&, node]() {
+#if defined(__linux__)
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for( int cpu : _topology.cpus[node] )
+                    CPU_SET(cpu, &set);
+                pthread_setaffinity_np( pthread_self(), sizeof(set), &set );
+#endif
+                work(node);
+            });
+        }
+    }
+    work(0);
+    for( std::thread& thread : threads )
+        thread.join();
+
+    if( error )
+        std::rethrow_exception(error);
+}
+
+} // namespace util
@@ -0,0 +1,567 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Runs task(i) for every i in [0,n) using a set of worker threads.
+// Tasks are handed out in increasing order. The first exception thrown
+// by any task is rethrown in the calling thread.
+template < class Task >
+void parallel_for( size_t n, Task task ) {
+    size_t hardware = std::max( 1u, std::thread::hardware_concurrency() );
+    size_t workers = std::min( n, hardware );
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&]() {
+        for( size_t i = next++; i < n; i = next++ ) {
+            try {
+                task(i);
+            } catch( ... ) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if( !error )
+                    error = std::current_exception();
+                next = n;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for( size_t t = 1; t < workers; ++t )
+        threads.emplace_back(work);
+    work();
+    for( std::thread& thread : threads )
+        thread.join();
+
+    if( error )
+        std::rethrow_exception(error);
+}
+
+// Contiguous piece of a concatenation: elements [first,last) of the
+// whole sequence. A chunk may span several segments.
+struct Chunk {
+    size_t first;
+    size_t last;
+
+    size_t size() const { return last - first; }
+};
+
+// Prefix sums over the lengths of the segments of a table, to locate
+// elements by their position in the concatenation.
+template < class ContainerIt >
+class SegmentIndex {
+public:
+    using ElementIt = decltype(std::declval<range<ContainerIt>>().begin());
+
+    // Whether an element inside a segment is reached in constant time
+    static constexpr bool random_access = std::is_base_of<std::random_access_iterator_tag,
+            typename std::iterator_traits<ElementIt>::iterator_category>::value;
+
+    SegmentIndex( MultiRange<ContainerIt> ranges ) :
+        _ranges( ranges ),
+        _table( _ranges.data() ),
+        _offsets( ranges.size() + 1 )
+    {
+        for( size_t i = 0; i < _ranges.size(); ++i )
+            _offsets[i+1] = _offsets[i] + std::distance( _table[i].begin(), _table[i].end() );
+    }
+
+    // Number of elements
+    size_t size() const { return _offsets.back(); }
+
+    size_t num_segments() const { return _offsets.size() - 1; }
+
+    size_t segment_size( size_t segment ) const {
+        return _offsets[segment+1] - _offsets[segment];
+    }
+
+    // Position of the first element of a segment
+    size_t segment_offset( size_t segment ) const { return _offsets[segment]; }
+
+    // Non-empty segment that holds the element at a position
+    size_t segment_of( size_t position ) const {
+        return std::upper_bound( _offsets.begin(), _offsets.end(), position ) - _offsets.begin() - 1;
+    }
+
+    // Iterator to the element at a position, end() if past the last one
+    typename MultiRange<ContainerIt>::iterator iterator_at( size_t position ) const {
+        if( position >= size() )
+            return _ranges.end();
+        size_t s = segment_of(position);
+        return _ranges.make_iterator( s, std::next( _table[s].begin(), position - _offsets[s] ) );
+    }
+
+    // Calls f(segment, first, last) for each piece of a segment in chunk.
+    // If f returns bool, returning true stops the walk.
+    template < class F >
+    void for_each_slice( Chunk chunk, F&& f ) const {
+        for( size_t s = segment_of(chunk.first), position = chunk.first; position < chunk.last; ++s ) {
+            size_t begin = position - _offsets[s];
+            size_t end = std::min( chunk.last, _offsets[s+1] ) - _offsets[s];
+            if( end > begin ) {
+                UTIL_SEGMENT_SCOPE( _table, s, end - begin );
+                ElementIt first = std::next( _table[s].begin(), begin );
+                ElementIt last = std::next( first, end - begin );
+                if constexpr( std::is_same<decltype(f( s, first, last )), bool>::value ) {
+                    if( f( s, first, last ) )
+                        return;
+                } else {
+                    f( s, first, last );
+                }
+            }
+            position = _offsets[s] + end;
+        }
+    }
+
+private:
+    MultiRange<ContainerIt> _ranges;
+    range<ContainerIt>*     _table;
+    std::vector<size_t>     _offsets;
+};
+
+namespace detail {
+
+struct NeverStop {
+    bool operator()( Chunk ) const { return false; }
+};
+
+} // namespace detail
+
+// Runs work on chunks of a concatenation in parallel, choosing the chunk
+// size (grain) on the fly.
+//
+// The first chunks of a run are timed to estimate the cost of each
+// element; the grain is then set so that each chunk takes about
+// target_time. Chunk ends are moved to a segment boundary when one is
+// close, so segments that are already reasonably sized are processed
+// whole and tiny segments are grouped. The grain learnt in a run is
+// remembered under a user provided tag and used to start the next run
+// with the same tag.
+class AdaptiveExecutor {
+public:
+    explicit AdaptiveExecutor( std::chrono::nanoseconds target_time = std::chrono::microseconds(100),
+                               size_t samples = 8 ) :
+        _target_time( target_time ),
+        _samples( samples )
+    {
+    }
+
+    // Executor shared by the algorithms of this library
+    static AdaptiveExecutor& global() {
+        static AdaptiveExecutor executor;
+        return executor;
+    }
+
+    // Grain remembered for a tag, 0 if it has not been tuned yet
+    size_t grain( const std::string& tag ) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _grains.find(tag);
+        return it != _grains.end()? it->second : 0;
+    }
+
+    // Calls f(chunk) for chunks that together cover index exactly once.
+    // Returns the chunks in order together with the value returned by f
+    // for each of them (or just the chunks if f returns void).
+    //
+    // Chunks are claimed in increasing order. Before processing a chunk,
+    // a worker checks stop(chunk): if it returns true the chunk is skipped
+    // and the worker quits, so that searches can finish early.
+    template < class ContainerIt, class F, class Stop = detail::NeverStop >
+    auto for_each_chunk( const SegmentIndex<ContainerIt>& index, const std::string& tag,
+                         F f, Stop stop = Stop() );
+
+private:
+    // Largest chunk that ends close to a segment boundary. Without random
+    // access, chunks always end at one: a chunk starting inside a segment
+    // would walk the segment from its start.
+    template < class ContainerIt >
+    static size_t chunk_end( const SegmentIndex<ContainerIt>& index, size_t first, size_t grain ) {
+        size_t last = std::min( first + grain, index.size() );
+        if( last == index.size() )
+            return last;
+        size_t s = index.segment_of(last);
+        size_t before = index.segment_offset(s);
+        size_t after = before + index.segment_size(s);
+        if constexpr( !SegmentIndex<ContainerIt>::random_access )
+            return before > first? before : after;
+        if( after - last <= grain / 4 )
+            return after;
+        if( last - before <= grain / 4 && before > first )
+            return before;
+        return last;
+    }
+
+    std::chrono::nanoseconds _target_time;
+    size_t                   _samples;
+
+    mutable std::mutex                      _mutex;
+    std::unordered_map<std::string,size_t> _grains;
+};
+
+template < class ContainerIt, class F, class Stop >
+auto AdaptiveExecutor::for_each_chunk( const SegmentIndex<ContainerIt>& index, const std::string& tag,
+                                       F f, Stop stop )
+{
+    using R = decltype( f(Chunk()) );
+    using Result = std::conditional_t<std::is_void<R>::value, Chunk, std::pair<Chunk,R>>;
+
+    const size_t total = index.size();
+    const size_t workers = std::max( 1u, std::thread::hardware_concurrency() );
+    const size_t max_grain = std::max<size_t>( 1, total / workers );
+
+    // Start small so that the first timings arrive early
+    size_t initial = grain(tag);
+    if( initial == 0 )
+        initial = std::max<size_t>( 1, std::min<size_t>( 256, total / (workers * 8) ) );
+    std::atomic<size_t> current_grain( std::min( initial, max_grain ) );
+
+    std::atomic<size_t> cursor(0);
+    std::atomic<size_t> samples_taken(0);
+    std::mutex          mutex;
+    std::chrono::nanoseconds sampled_time(0);
+    size_t              sampled_elements = 0;
+    std::vector<Result> results;
+
+    parallel_for( std::min( workers, std::max<size_t>( 1, total ) ), [&]( size_t ) {
+        std::vector<Result> local;
+        for( ;; ) {
+            // Claim the next chunk
+            size_t first = cursor.load();
+            size_t last = first;
+            do {
+                if( first >= total )
+                    break;
+                last = chunk_end( index, first, current_grain.load() );
+            } while( !cursor.compare_exchange_weak( first, last ) );
+            if( first >= total )
+                break;
+
+            Chunk chunk{ first, last };
+            if( stop(chunk) )
+                break;
+            bool timed = samples_taken.load() < _samples;
+            auto start = std::chrono::steady_clock::now();
+            if constexpr( std::is_void<R>::value ) {
+                f( chunk );
+                local.push_back( chunk );
+            } else {
+                local.emplace_back( chunk, f(chunk) );
+            }
+
+            if( timed ) {
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                std::lock_guard<std::mutex> lock(mutex);
+                sampled_time += elapsed;
+                sampled_elements += chunk.size();
+                if( ++samples_taken == _samples && sampled_time.count() > 0 ) {
+                    double per_element = double(sampled_time.count()) / sampled_elements;
+                    size_t tuned = size_t( _target_time.count() / per_element );
+                    current_grain = std::min( std::max<size_t>( tuned, 1 ), max_grain );
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        results.insert( results.end(), local.begin(), local.end() );
+    });
+
+    if( samples_taken.load() >= _samples ) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _grains[tag] = current_grain.load();
+    }
+
+    std::sort( results.begin(), results.end(), []( const Result& a, const Result& b ) {
+        if constexpr( std::is_void<R>::value )
+            return a.first < b.first;
+        else
+            return a.first.first < b.first.first;
+    });
+    return results;
+}
+
+// Copies the elements that satisfy pred to out_true and the rest to
+// out_false, preserving their relative order.
+//
+// Runs in two passes: the elements of each chunk are counted in parallel,
+// a prefix sum gives each chunk its exact output position and then all
+// chunks are scattered in parallel. pred is evaluated twice for each
+// element, so it must not have side effects.
+// Output iterators must be random access and have enough room.
+// The chunk size is tuned by AdaptiveExecutor::global() under tag.
+template < class ContainerIt, class Predicate, class OutputTrue, class OutputFalse >
+std::pair<OutputTrue,OutputFalse>
+partition_copy( MultiRange<ContainerIt> ranges, Predicate pred,
+                OutputTrue out_true, OutputFalse out_false,
+                const std::string& tag = "partition_copy" )
+{
+    UTIL_TRACE_ALGORITHM( "partition_copy", ranges.size() );
+    SegmentIndex<ContainerIt> index( ranges );
+
+    // First pass: count matching elements
+    auto counts = AdaptiveExecutor::global().for_each_chunk( index, tag, [&]( Chunk chunk ) {
+        size_t matches = 0;
+        index.for_each_slice( chunk, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first )
+                matches += bool(pred(*first));
+        });
+        return matches;
+    });
+
+    // Exclusive prefix sums: output position for each chunk
+    std::vector<size_t> true_offset( counts.size() + 1 );
+    std::vector<size_t> false_offset( counts.size() + 1 );
+    for( size_t i = 0; i < counts.size(); ++i ) {
+        true_offset[i+1] = true_offset[i] + counts[i].second;
+        false_offset[i+1] = false_offset[i] + counts[i].first.size() - counts[i].second;
+    }
+
+    // Second pass: scatter to exact positions
+    parallel_for( counts.size(), [&]( size_t i ) {
+        OutputTrue t = out_true + true_offset[i];
+        OutputFalse f = out_false + false_offset[i];
+        index.for_each_slice( counts[i].first, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first ) {
+                if( pred(*first) )
+                    *t++ = *first;
+                else
+                    *f++ = *first;
+            }
+        });
+    });
+
+    return { out_true + true_offset.back(), out_false + false_offset.back() };
+}
+
+// Appends every element to buckets[key(element)], preserving the relative
+// order of the elements that land on the same bucket.
+//
+// buckets is a random access sequence of containers supporting size(),
+// resize() and random access iterators. Like partition_copy, it counts
+// per chunk and bucket in parallel, sizes each bucket once and scatters
+// in parallel without locking. key is evaluated twice for each element.
+template < class ContainerIt, class KeyFunction, class Buckets >
+void bucketize( MultiRange<ContainerIt> ranges, KeyFunction key, Buckets& buckets,
+                const std::string& tag = "bucketize" )
+{
+    UTIL_TRACE_ALGORITHM( "bucketize", ranges.size() );
+    const size_t num_buckets = std::distance( std::begin(buckets), std::end(buckets) );
+    auto bucket = std::begin(buckets);
+    SegmentIndex<ContainerIt> index( ranges );
+
+    // First pass: histogram for each chunk
+    auto histograms = AdaptiveExecutor::global().for_each_chunk( index, tag, [&]( Chunk chunk ) {
+        std::vector<size_t> counts( num_buckets );
+        index.for_each_slice( chunk, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first ) {
+                size_t b = key(*first);
+                assert( b < num_buckets );
+                counts[b]++;
+            }
+        });
+        return counts;
+    });
+
+    // Exclusive prefix sum over chunks, starting after current contents
+    for( size_t b = 0; b < num_buckets; ++b ) {
+        size_t position = bucket[b].size();
+        for( auto& histogram : histograms ) {
+            size_t count = histogram.second[b];
+            histogram.second[b] = position;
+            position += count;
+        }
+        bucket[b].resize(position);
+    }
+
+    // Second pass: scatter to exact positions
+    parallel_for( histograms.size(), [&]( size_t i ) {
+        std::vector<size_t>& positions = histograms[i].second;
+        index.for_each_slice( histograms[i].first, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first ) {
+                size_t b = key(*first);
+                std::begin(bucket[b])[positions[b]++] = *first;
+            }
+        });
+    });
+}
+
+// Lets a caller abandon a parallel search, explicitly or after a timeout.
+// Copies share their state.
+class CancellationToken {
+public:
+    CancellationToken() :
+        _state( std::make_shared<State>() )
+    {
+    }
+
+    // Token that cancels itself once timeout has elapsed
+    static CancellationToken with_timeout( std::chrono::nanoseconds timeout ) {
+        CancellationToken token;
+        token._state->deadline = std::chrono::steady_clock::now() + timeout;
+        return token;
+    }
+
+    void cancel() { _state->cancelled = true; }
+
+    bool cancelled() const {
+        if( _state->cancelled.load(std::memory_order_relaxed) )
+            return true;
+        if( _state->deadline != std::chrono::steady_clock::time_point::max()
+         && std::chrono::steady_clock::now() >= _state->deadline ) {
+            _state->cancelled = true;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct State {
+        std::atomic<bool>                     cancelled{false};
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
+
+    std::shared_ptr<State> _state;
+};
+
+namespace detail {
+
+// Lowers an atomic position to value if it is smaller
+inline void fetch_min( std::atomic<size_t>& position, size_t value ) {
+    size_t current = position.load();
+    while( value < current && !position.compare_exchange_weak( current, value ) ) {
+    }
+}
+
+// Parallel search for the first position i where match(element, i)
+// holds. Workers check the best match found so far at chunk boundaries
+// and skip chunks that start after it; they also stop when token is
+// cancelled.
+// Returns the position of the first match, or npos if there is none or
+// the search was cancelled before it could be decided.
+template < class ContainerIt, class Match >
+size_t parallel_find( const SegmentIndex<ContainerIt>& index, Match match,
+                      const CancellationToken& token, const std::string& tag )
+{
+    constexpr size_t npos = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> best( npos );
+    std::atomic<size_t> skipped( npos ); // First chunk dropped by cancellation
+
+    AdaptiveExecutor::global().for_each_chunk( index, tag, [&]( Chunk chunk ) {
+        size_t position = chunk.first;
+        index.for_each_slice( chunk, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first, ++position ) {
+                if( match(first, position) ) {
+                    fetch_min( best, position );
+                    return true;
+                }
+            }
+            return false;
+        });
+    }, [&]( Chunk chunk ) {
+        if( token.cancelled() ) {
+            fetch_min( skipped, chunk.first );
+            return true;
+        }
+        return chunk.first > best.load();
+    });
+
+    // A match is only known to be the first if no chunk before it was
+    // dropped
+    return best.load() < skipped.load()? best.load() : npos;
+}
+
+} // namespace detail
+
+// Parallel search of the first element that satisfies pred, in
+// concatenation order. Returns end() if there is none or if token was
+// cancelled before the search completed.
+template < class ContainerIt, class Predicate >
+typename MultiRange<ContainerIt>::iterator
+find_if( MultiRange<ContainerIt> ranges, Predicate pred,
+         CancellationToken token = CancellationToken(), const std::string& tag = "find_if" )
+{
+    UTIL_TRACE_ALGORITHM( "find_if", ranges.size() );
+    SegmentIndex<ContainerIt> index( ranges );
+    size_t position = detail::parallel_find( index, [&]( auto element, size_t ) {
+        return bool(pred(*element));
+    }, token, tag );
+    return index.iterator_at( position );
+}
+
+// Parallel check of whether some element satisfies pred. Workers stop as
+// soon as any of them finds one. Returns false if token was cancelled
+// before an element was found.
+template < class ContainerIt, class Predicate >
+bool any_of( MultiRange<ContainerIt> ranges, Predicate pred,
+             CancellationToken token = CancellationToken(), const std::string& tag = "any_of" )
+{
+    UTIL_TRACE_ALGORITHM( "any_of", ranges.size() );
+    SegmentIndex<ContainerIt> index( ranges );
+    std::atomic<bool> found( false );
+
+    AdaptiveExecutor::global().for_each_chunk( index, tag, [&]( Chunk chunk ) {
+        index.for_each_slice( chunk, [&]( size_t, auto first, auto last ) {
+            for( ; first != last; ++first ) {
+                if( pred(*first) ) {
+                    found = true;
+                    return true;
+                }
+            }
+            return false;
+        });
+    }, [&]( Chunk ) {
+        return found.load() || token.cancelled();
+    });
+    return found;
+}
+
+// Parallel search of the first occurrence of [needle_first,needle_last)
+// in concatenation order. Occurrences may cross segment boundaries.
+// Returns end() if there is none or if token was cancelled before the
+// search completed.
+template < class ContainerIt, class NeedleIt >
+typename MultiRange<ContainerIt>::iterator
+search( MultiRange<ContainerIt> ranges, NeedleIt needle_first, NeedleIt needle_last,
+        CancellationToken token = CancellationToken(), const std::string& tag = "search" )
+{
+    UTIL_TRACE_ALGORITHM( "search", ranges.size() );
+    SegmentIndex<ContainerIt> index( ranges );
+    const size_t length = std::distance( needle_first, needle_last );
+    if( length == 0 || length > index.size() )
+        return length == 0? ranges.begin() : ranges.end();
+    const size_t last_start = index.size() - length;
+
+    size_t position = detail::parallel_find( index, [&]( auto element, size_t position ) {
+        if( position > last_start || !(*element == *needle_first) )
+            return false;
+        // Candidate: compare the rest, possibly across segments
+        auto it = index.iterator_at( position );
+        for( NeedleIt needle = needle_first; needle != needle_last; ++needle, ++it ) {
+            if( !(*it == *needle) )
+                return false;
+        }
+        return true;
+    }, token, tag );
+    return index.iterator_at( position );
+}
+
+} // namespace util
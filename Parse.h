@@ -0,0 +1,153 @@
+
+#pragma once
+
+#include <charconv>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MultiIterator.h"
+
+namespace util {
+
+namespace detail {
+
+inline bool is_delimiter( char c, char separator ) {
+    return c == separator || c == '\n';
+}
+
+// Finds the first separator or end of line in [first,last).
+// Classifies 16 characters at a time with SSE2.
+inline const char* find_delimiter( const char* first, const char* last, char separator ) {
+#if defined(__SSE2__)
+    const __m128i sep = _mm_set1_epi8( separator );
+    const __m128i eol = _mm_set1_epi8( '\n' );
+    for( ; last - first >= 16; first += 16 ) {
+        __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(first) );
+        __m128i found = _mm_or_si128( _mm_cmpeq_epi8(block, sep), _mm_cmpeq_epi8(block, eol) );
+        int mask = _mm_movemask_epi8( found );
+        if( mask != 0 )
+            return first + __builtin_ctz(mask);
+    }
+#endif
+    while( first != last && !is_delimiter(*first, separator) )
+        ++first;
+    return first;
+}
+
+// Parses tokens fed in pieces. Only tokens cut by the end of a piece are
+// copied, everything else is parsed in place.
+template < class T, class OutputIt >
+class NumberParser {
+public:
+    NumberParser( char separator, OutputIt out ) :
+        _separator( separator ),
+        _out( out ),
+        _carry()
+    {
+    }
+
+    void feed( const char* first, const char* last ) {
+        if( !_carry.empty() ) {
+            // Complete the token that started on a previous piece
+            const char* delimiter = find_delimiter( first, last, _separator );
+            _carry.append( first, delimiter );
+            if( delimiter == last )
+                return;
+            parse( _carry.data(), _carry.data() + _carry.size() );
+            _carry.clear();
+            first = delimiter + 1;
+        }
+
+        for( ;; ) {
+            const char* delimiter = find_delimiter( first, last, _separator );
+            if( delimiter == last ) {
+                _carry.assign( first, last );
+                return;
+            }
+            parse( first, delimiter );
+            first = delimiter + 1;
+        }
+    }
+
+    template < class It >
+    void feed_elements( It first, It last ) {
+        for( ; first != last; ++first ) {
+            if( is_delimiter(*first, _separator) ) {
+                parse( _carry.data(), _carry.data() + _carry.size() );
+                _carry.clear();
+            } else {
+                _carry.push_back( *first );
+            }
+        }
+    }
+
+    OutputIt finish() {
+        parse( _carry.data(), _carry.data() + _carry.size() );
+        _carry.clear();
+        return _out;
+    }
+
+private:
+    static bool is_blank( char c ) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Parses one token. Blank tokens are skipped.
+    void parse( const char* first, const char* last ) {
+        while( first != last && is_blank(*first) )
+            ++first;
+        while( first != last && is_blank(*(last-1)) )
+            --last;
+        if( first == last )
+            return;
+
+        T value;
+        std::from_chars_result result = std::from_chars( first, last, value );
+        if( result.ec == std::errc::result_out_of_range )
+            throw std::out_of_range( "parse_numbers: out of range '" + std::string(first, last) + "'" );
+        if( result.ec != std::errc() || result.ptr != last )
+            throw std::invalid_argument( "parse_numbers: invalid number '" + std::string(first, last) + "'" );
+        *_out++ = value;
+    }
+
+    char        _separator;
+    OutputIt    _out;
+    std::string _carry;
+};
+
+} // namespace detail
+
+// Parses the numbers in a segmented text buffer. Numbers are delimited by
+// separator or by end of lines; surrounding blanks and empty fields are
+// ignored. Throws std::invalid_argument if a field is not a number.
+template < class T, class ContainerIt, class OutputIt >
+OutputIt parse_numbers( MultiRange<ContainerIt> ranges, char separator, OutputIt out ) {
+    UTIL_TRACE_ALGORITHM( "parse_numbers", ranges.size() );
+    detail::NumberParser<T,OutputIt> parser( separator, out );
+    for( range<ContainerIt>* r = ranges.data(); r != ranges.data() + ranges.size(); ++r ) {
+        UTIL_WHOLE_SEGMENT_SCOPE( ranges.data(), r - ranges.data(), *r );
+        if constexpr( is_contiguous_iterator<ContainerIt>::value ) {
+            auto text = contiguous( *r );
+            parser.feed( text.first, text.last );
+        } else {
+            parser.feed_elements( r->begin(), r->end() );
+        }
+    }
+    return parser.finish();
+}
+
+template < class T, class ContainerIt >
+std::vector<T> parse_numbers( MultiRange<ContainerIt> ranges, char separator ) {
+    std::vector<T> numbers;
+    parse_numbers<T>( ranges, separator, std::back_inserter(numbers) );
+    return numbers;
+}
+
+} // namespace util
@@ -0,0 +1,259 @@
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Blocks.h"
+#include "MultiIterator.h"
+
+// Fused transform/filter pipelines over a MultiRange:
+//
+//   long total = util::pipe( ranges ) | util::map( f ) | util::where( p ) | util::sum();
+//
+// Nothing runs until a terminal (sum, count, reduce, to_vector) is applied.
+// The whole pipeline then becomes a single loop per segment: elements are
+// processed in blocks of pipeline_block_size, every stage runs over the
+// whole block before the next one, and filters compact the block without
+// branches. Blocks come from for_each_block(), so tiny or non-contiguous
+// segments are gathered into full blocks first. Values produced by map()
+// must be default constructible.
+
+namespace util {
+
+constexpr size_t pipeline_block_size = 256;
+
+namespace detail {
+
+template < class F >
+struct MapStage {
+    F f;
+
+    template < class T >
+    using output = std::decay_t<std::invoke_result_t<const F&, const T&>>;
+
+    template < class T, class Next >
+    void operator()( const T* in, size_t n, Next&& next ) const {
+        output<T> out[pipeline_block_size];
+        for( size_t i = 0; i < n; ++i )
+            out[i] = std::invoke( f, in[i] );
+        next( static_cast<const output<T>*>(out), n );
+    }
+};
+
+template < class P >
+struct WhereStage {
+    P predicate;
+
+    template < class T >
+    using output = T;
+
+    template < class T, class Next >
+    void operator()( const T* in, size_t n, Next&& next ) const {
+        // Every element is written, only the selected ones are kept
+        T out[pipeline_block_size];
+        size_t kept = 0;
+        for( size_t i = 0; i < n; ++i ) {
+            out[kept] = in[i];
+            kept += bool( std::invoke( predicate, in[i] ) );
+        }
+        next( static_cast<const T*>(out), kept );
+    }
+};
+
+// Type of the values coming out of a list of stages
+template < class T, class... Stages >
+struct pipe_output {
+    using type = T;
+};
+
+template < class T, class Stage, class... Stages >
+struct pipe_output<T, Stage, Stages...> :
+    pipe_output<typename Stage::template output<T>, Stages...>
+{
+};
+
+// Base of the objects that end a pipeline
+struct Terminal {};
+
+struct SumTerminal : Terminal {
+    template < class T >
+    struct state {
+        explicit state( const SumTerminal& ) {}
+
+        void operator()( const T* in, size_t n ) {
+            for( size_t i = 0; i < n; ++i )
+                total += in[i];
+        }
+
+        T result() { return total; }
+
+        T total{};
+    };
+};
+
+struct CountTerminal : Terminal {
+    template < class T >
+    struct state {
+        explicit state( const CountTerminal& ) {}
+
+        void operator()( const T*, size_t n ) {
+            total += n;
+        }
+
+        size_t result() { return total; }
+
+        size_t total = 0;
+    };
+};
+
+template < class Init, class Op >
+struct ReduceTerminal : Terminal {
+    Init init;
+    Op   op;
+
+    template < class T >
+    struct state {
+        explicit state( const ReduceTerminal& terminal ) :
+            total( terminal.init ),
+            op( terminal.op )
+        {
+        }
+
+        void operator()( const T* in, size_t n ) {
+            for( size_t i = 0; i < n; ++i )
+                total = std::invoke( op, std::move(total), in[i] );
+        }
+
+        Init result() { return std::move(total); }
+
+        Init total;
+        Op   op;
+    };
+};
+
+struct ToVectorTerminal : Terminal {
+    template < class T >
+    struct state {
+        explicit state( const ToVectorTerminal& ) {}
+
+        void operator()( const T* in, size_t n ) {
+            values.insert( values.end(), in, in + n );
+        }
+
+        std::vector<T> result() { return std::move(values); }
+
+        std::vector<T> values;
+    };
+};
+
+} // namespace detail
+
+// Lazily composed pipeline; see the top of this file
+template < class ContainerIt, class... Stages >
+class Pipe {
+public:
+    using input_type = typename std::iterator_traits<ContainerIt>::value_type;
+    using value_type = typename detail::pipe_output<input_type, Stages...>::type;
+
+    Pipe( MultiRange<ContainerIt> ranges, std::tuple<Stages...> stages ) :
+        _ranges( std::move(ranges) ),
+        _stages( std::move(stages) )
+    {
+    }
+
+    // Pipeline with one more stage
+    template < class Stage >
+    Pipe<ContainerIt, Stages..., Stage> then( Stage stage ) const {
+        return { _ranges, std::tuple_cat( _stages, std::make_tuple(std::move(stage)) ) };
+    }
+
+    // Runs the pipeline into a terminal
+    template < class Terminal >
+    auto run( const Terminal& terminal ) {
+        UTIL_TRACE_ALGORITHM( "pipe", _ranges.size() );
+        typename Terminal::template state<value_type> state( terminal );
+
+        for_each_block( _ranges, pipeline_block_size, [&]( const input_type* block, size_t n ) {
+            push<0>( block, n, state );
+        });
+        return state.result();
+    }
+
+private:
+    // Feeds a block to stage I, or to the terminal after the last stage
+    template < size_t I, class T, class State >
+    void push( const T* in, size_t n, State& state ) const {
+        if constexpr( I == sizeof...(Stages) ) {
+            state( in, n );
+        } else {
+            std::get<I>(_stages)( in, n, [&]( auto* out, size_t m ) {
+                this->push<I+1>( out, m, state );
+            });
+        }
+    }
+
+    MultiRange<ContainerIt> _ranges;
+    std::tuple<Stages...>   _stages;
+};
+
+template < class ContainerIt >
+Pipe<ContainerIt> pipe( MultiRange<ContainerIt> ranges ) {
+    return { std::move(ranges), std::tuple<>() };
+}
+
+// Applies f to every element
+template < class F >
+detail::MapStage<F> map( F f ) {
+    return { std::move(f) };
+}
+
+// Keeps the elements for which predicate is true
+template < class P >
+detail::WhereStage<P> where( P predicate ) {
+    return { std::move(predicate) };
+}
+
+// Sum of the elements
+inline detail::SumTerminal sum() {
+    return {};
+}
+
+// Number of elements
+inline detail::CountTerminal count() {
+    return {};
+}
+
+// Left fold of the elements with op, starting from init
+template < class Init, class Op >
+detail::ReduceTerminal<Init,Op> reduce( Init init, Op op ) {
+    return { {}, std::move(init), std::move(op) };
+}
+
+// The elements, in order
+inline detail::ToVectorTerminal to_vector() {
+    return {};
+}
+
+template < class ContainerIt, class... Stages, class F >
+auto operator|( const Pipe<ContainerIt, Stages...>& p, detail::MapStage<F> stage ) {
+    return p.then( std::move(stage) );
+}
+
+template < class ContainerIt, class... Stages, class P >
+auto operator|( const Pipe<ContainerIt, Stages...>& p, detail::WhereStage<P> stage ) {
+    return p.then( std::move(stage) );
+}
+
+template < class ContainerIt, class... Stages, class Terminal,
+           class = std::enable_if_t<std::is_base_of<detail::Terminal, Terminal>::value> >
+auto operator|( Pipe<ContainerIt, Stages...> p, const Terminal& terminal ) {
+    return p.run( terminal );
+}
+
+} // namespace util
@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace util {
+
+template < class Iterator >
+struct range {
+    Iterator first;
+    Iterator last;
+
+    Iterator begin() { return first; }
+    Iterator end()   { return last; }
+};
+
+// Whether the elements an iterator refers to are laid out contiguously in
+// memory, so that a whole range can be accessed through a plain pointer.
+template < class It, class = void >
+struct is_contiguous_iterator : std::is_pointer<It> {};
+
+#if defined(__cpp_lib_concepts)
+template < class It >
+struct is_contiguous_iterator<It, std::enable_if_t<!std::is_pointer<It>::value>> :
+    std::integral_constant<bool, std::contiguous_iterator<It>>
+{
+};
+#else
+template < class It >
+struct is_contiguous_iterator<It, std::enable_if_t<std::is_class<It>::value>> {
+private:
+    using V = typename std::iterator_traits<It>::value_type;
+
+    template < class T, bool = std::is_object<T>::value && !std::is_array<T>::value
+                                && !std::is_same<T,bool>::value >
+    struct vector_iterator : std::false_type {};
+
+    template < class T >
+    struct vector_iterator<T,true> : std::integral_constant<bool,
+            std::is_same<It, typename std::vector<T>::iterator>::value
+         || std::is_same<It, typename std::vector<T>::const_iterator>::value>
+    {
+    };
+
+public:
+    static constexpr bool value = vector_iterator<V>::value
+         || std::is_same<It, std::string::iterator>::value
+         || std::is_same<It, std::string::const_iterator>::value;
+};
+#endif
+
+// Views a range of contiguous elements through plain pointers
+template < class It >
+auto contiguous( range<It> r ) {
+    static_assert( is_contiguous_iterator<It>::value, "Range is not contiguous" );
+    using pointer = std::remove_reference_t<decltype(*r.first)>*;
+    if( r.first == r.last )
+        return range<pointer>{ nullptr, nullptr };
+    pointer first = std::addressof(*r.first);
+    return range<pointer>{ first, first + std::distance(r.first, r.last) };
+}
+
+} // namespace util
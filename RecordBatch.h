@@ -0,0 +1,134 @@
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Fixed-size slice of a column, laid out like an Arrow primitive array:
+// a values buffer plus an optional validity bitmap.
+template < class T >
+struct RecordBatch {
+    size_t              length;     // Number of rows
+    size_t              null_count; // Number of rows without a value
+    const std::uint8_t* validity;   // Bit i set if row i has a value (LSB first), nullptr if all rows do
+    const T*            values;     // Row values; unspecified for null rows
+    std::shared_ptr<const void> storage; // Owns copied buffers; empty when values point into a segment
+
+    bool valid( size_t i ) const {
+        return !validity || (validity[i / 8] >> (i % 8)) & 1;
+    }
+};
+
+namespace detail {
+
+template < class T >
+struct column_type {
+    using type = T;
+    static constexpr bool nullable = false;
+};
+
+template < class T >
+struct column_type<std::optional<T>> {
+    using type = T;
+    static constexpr bool nullable = true;
+};
+
+// Buffers of a batch that could not reference segment memory
+template < class T >
+struct BatchStorage {
+    std::vector<T>            values;
+    std::vector<std::uint8_t> validity;
+};
+
+} // namespace detail
+
+// Cuts a concatenation in batches of batch_rows rows (the last one may be
+// shorter). Batches that fall inside a single contiguous segment reference
+// the segment memory directly; the others are copied. Columns of
+// std::optional<T> are always copied to build the validity bitmap.
+// Batches that reference segments are valid while the segments live.
+template < class ContainerIt >
+auto to_record_batches( MultiRange<ContainerIt> ranges, size_t batch_rows ) {
+    UTIL_TRACE_ALGORITHM( "to_record_batches", ranges.size() );
+    using value_type = typename std::iterator_traits<ContainerIt>::value_type;
+    using column = detail::column_type<value_type>;
+    using T = typename column::type;
+    constexpr bool zero_copy = !column::nullable && is_contiguous_iterator<ContainerIt>::value;
+    static_assert( !std::is_same<T,bool>::value, "Boolean columns are not supported" );
+    assert( batch_rows > 0 );
+
+    std::vector<RecordBatch<T>> batches;
+
+    range<ContainerIt>* r = ranges.data();
+    range<ContainerIt>* last = ranges.data() + ranges.size();
+    auto element = r != last? r->begin() : ContainerIt();
+    size_t remaining = r != last? std::distance( r->begin(), r->end() ) : 0;
+
+    size_t total = 0;
+    for( range<ContainerIt>* s = r; s != last; ++s )
+        total += std::distance( s->begin(), s->end() );
+
+    for( size_t row = 0; row < total; ) {
+        size_t length = std::min( batch_rows, total - row );
+
+        // Skip exhausted and empty segments
+        while( remaining == 0 ) {
+            ++r;
+            element = r->begin();
+            remaining = std::distance( r->begin(), r->end() );
+        }
+
+        if constexpr( zero_copy ) {
+            if( remaining >= length ) {
+                batches.push_back( RecordBatch<T>{ length, 0, nullptr, std::addressof(*element), nullptr } );
+                std::advance( element, length );
+                remaining -= length;
+                row += length;
+                continue;
+            }
+        }
+
+        // Gather the batch from as many segments as needed
+        auto storage = std::make_shared<detail::BatchStorage<T>>();
+        storage->values.resize( length );
+        if( column::nullable )
+            storage->validity.resize( (length + 7) / 8 );
+        size_t null_count = 0;
+
+        for( size_t i = 0; i < length; ++i, ++element, --remaining ) {
+            while( remaining == 0 ) {
+                ++r;
+                element = r->begin();
+                remaining = std::distance( r->begin(), r->end() );
+            }
+            if constexpr( column::nullable ) {
+                if( element->has_value() ) {
+                    storage->values[i] = **element;
+                    storage->validity[i / 8] |= std::uint8_t(1u << (i % 8));
+                } else {
+                    null_count++;
+                }
+            } else {
+                storage->values[i] = *element;
+            }
+        }
+
+        const std::uint8_t* validity = column::nullable && null_count > 0? storage->validity.data() : nullptr;
+        batches.push_back( RecordBatch<T>{ length, null_count, validity, storage->values.data(), storage } );
+        row += length;
+    }
+    return batches;
+}
+
+} // namespace util
@@ -0,0 +1,433 @@
+
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Dynamic segment table: a B+-tree over the segments in order, where
+// every inner node keeps the number of elements and segments under each
+// child. Inserting, removing and splitting segments, and finding the
+// element at a global index, are O(log n) in the number of segments;
+// elements never move, only the table changes, as in a rope.
+//
+// Nodes hold up to B entries, with the counts in their own arrays so that
+// a lookup scans a few cache lines per level. Segments need random access
+// iterators, so that their length is known.
+template < class ContainerIt, size_t B = 32 >
+class SegmentTree {
+public:
+    static_assert( B >= 4, "Nodes must hold at least 4 entries" );
+    static_assert( std::is_base_of<std::random_access_iterator_tag,
+                       typename std::iterator_traits<ContainerIt>::iterator_category>::value,
+                   "Segments need random access iterators" );
+
+    using Segment   = range<ContainerIt>;
+    using reference = typename std::iterator_traits<ContainerIt>::reference;
+
+    SegmentTree() :
+        _root( std::make_unique<Leaf>() )
+    {
+    }
+
+    // Moveable
+    SegmentTree( SegmentTree&& ) = default;
+    SegmentTree& operator=( SegmentTree&& ) = default;
+
+    // Number of elements
+    size_t size() const { return _elements; }
+
+    size_t num_segments() const { return _segments; }
+
+    // Segment holding the element at index, and the position of the element
+    // in it. Empty segments are never returned.
+    std::pair<size_t,size_t> locate( size_t index ) const {
+        Position position = find( index );
+        return { position.segment, position.offset };
+    }
+
+    reference operator[]( size_t index ) const {
+        Position position = find( index );
+        return position.leaf->entries[position.slot].first[position.offset];
+    }
+
+    Segment segment( size_t s ) const {
+        assert( s < num_segments() );
+        const Node* node = _root.get();
+        while( !node->leaf ) {
+            const Inner& inner = static_cast<const Inner&>(*node);
+            size_t i = 0;
+            for( ; s >= inner.segments[i]; ++i )
+                s -= inner.segments[i];
+            node = inner.children[i].get();
+        }
+        return static_cast<const Leaf&>(*node).entries[s];
+    }
+
+    // Inserts a segment so that it becomes segment number s
+    void insert_segment( size_t s, Segment segment ) {
+        assert( s <= num_segments() );
+        size_t length = std::distance( segment.first, segment.last );
+        if( std::unique_ptr<Node> sibling = insert_into( *_root, s, segment, length ) )
+            grow( std::move(sibling) );
+        _elements += length;
+        ++_segments;
+    }
+
+    void push_back( Segment segment ) {
+        insert_segment( num_segments(), segment );
+    }
+
+    void erase_segment( size_t s ) {
+        assert( s < num_segments() );
+        _elements -= erase_from( *_root, s );
+        --_segments;
+        shrink();
+    }
+
+    // Splits the segment holding the element at index, so that index starts
+    // a segment, and returns that segment. An index of size() returns
+    // num_segments().
+    size_t split( size_t index ) {
+        if( index == size() )
+            return num_segments();
+        Position position = find( index );
+        if( position.offset == 0 )
+            return position.segment;
+        Segment whole = position.leaf->entries[position.slot];
+        ContainerIt middle = whole.first + position.offset;
+        resize( *_root, position.segment, { whole.first, middle }, position.offset );
+        _elements -= whole.last - middle;
+        insert_segment( position.segment + 1, { middle, whole.last } );
+        return position.segment + 1;
+    }
+
+    // Inserts the elements of segment before the element at index
+    void insert( size_t index, Segment segment ) {
+        insert_segment( split(index), segment );
+    }
+
+    // Removes the elements from first to last, splitting the segments at
+    // both ends as needed
+    void erase( size_t first, size_t last ) {
+        assert( first <= last && last <= size() );
+        if( first == last )
+            return;
+        size_t s = split( first );
+        for( size_t n = split( last ) - s; n > 0; --n )
+            erase_segment( s );
+    }
+
+    // Calls f(segment) for every segment, in order
+    template < class F >
+    void for_each_segment( F&& f ) const {
+        walk( *_root, f );
+    }
+
+    // MultiRange over the current segments, built in O(n). It refers to
+    // the elements, not to this tree, and is not affected by later edits.
+    MultiRange<ContainerIt> view() const {
+        std::vector<Segment> ranges;
+        ranges.reserve( num_segments() );
+        for_each_segment( [&]( const Segment& segment ) { ranges.push_back( segment ); } );
+        return MultiRange<ContainerIt>( ranges.begin(), ranges.end() );
+    }
+
+    // Nodes of the tree. The segments are not owned and not counted.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.tables = _leaves * sizeof(Leaf) + _inners * sizeof(Inner);
+        return usage;
+    }
+
+private:
+    struct Node {
+        explicit Node( bool is_leaf ) : leaf( is_leaf ) {}
+        virtual ~Node() = default;
+
+        bool   leaf;
+        size_t count = 0;
+        size_t elements[B]; // Elements under every entry
+    };
+
+    struct Leaf : Node {
+        Leaf() : Node( true ) {}
+
+        Segment entries[B];
+    };
+
+    struct Inner : Node {
+        Inner() : Node( false ) {}
+
+        size_t                segments[B]; // Segments under every child
+        std::unique_ptr<Node> children[B];
+    };
+
+    struct Position {
+        const Leaf* leaf;
+        size_t      slot;
+        size_t      segment;
+        size_t      offset;
+    };
+
+    Position find( size_t index ) const {
+        assert( index < size() );
+        const Node* node = _root.get();
+        size_t segment = 0;
+        while( !node->leaf ) {
+            const Inner& inner = static_cast<const Inner&>(*node);
+            size_t i = 0;
+            for( ; index >= inner.elements[i]; ++i ) {
+                index -= inner.elements[i];
+                segment += inner.segments[i];
+            }
+            node = inner.children[i].get();
+        }
+        size_t slot = 0;
+        for( ; index >= node->elements[slot]; ++slot )
+            index -= node->elements[slot];
+        return { static_cast<const Leaf*>(node), slot, segment + slot, index };
+    }
+
+    static size_t total_elements( const Node& node ) {
+        size_t total = 0;
+        for( size_t i = 0; i < node.count; ++i )
+            total += node.elements[i];
+        return total;
+    }
+
+    static size_t total_segments( const Node& node ) {
+        if( node.leaf )
+            return node.count;
+        const Inner& inner = static_cast<const Inner&>(node);
+        size_t total = 0;
+        for( size_t i = 0; i < inner.count; ++i )
+            total += inner.segments[i];
+        return total;
+    }
+
+    // Applies move(array) to every per-entry array of node and of other,
+    // which must be of the same kind
+    template < class F >
+    static void for_each_array( Node& node, Node& other, F&& move ) {
+        move( node.elements, other.elements );
+        if( node.leaf ) {
+            move( static_cast<Leaf&>(node).entries, static_cast<Leaf&>(other).entries );
+        } else {
+            move( static_cast<Inner&>(node).segments, static_cast<Inner&>(other).segments );
+            move( static_cast<Inner&>(node).children, static_cast<Inner&>(other).children );
+        }
+    }
+
+    // Moves the entries first to last of from to position at of to
+    static void transfer( Node& from, size_t first, size_t last, Node& to, size_t at ) {
+        size_t n = last - first;
+        for_each_array( from, to, [&]( auto* source, auto* destination ) {
+            std::move_backward( destination + at, destination + to.count, destination + to.count + n );
+            std::move( source + first, source + last, destination + at );
+            std::move( source + last, source + from.count, source + first );
+        });
+        from.count -= n;
+        to.count += n;
+    }
+
+    // Makes room for an entry at position at
+    static void open_slot( Node& node, size_t at ) {
+        for_each_array( node, node, [&]( auto* array, auto* ) {
+            std::move_backward( array + at, array + node.count, array + node.count + 1 );
+        });
+        ++node.count;
+    }
+
+    // Removes the entry at position at
+    static void close_slot( Node& node, size_t at ) {
+        for_each_array( node, node, [&]( auto* array, auto* ) {
+            std::move( array + at + 1, array + node.count, array + at );
+        });
+        --node.count;
+        if( !node.leaf )
+            static_cast<Inner&>(node).children[node.count].reset();
+    }
+
+    // Moves the upper half of the entries of node to a new sibling
+    std::unique_ptr<Node> split_node( Node& node ) {
+        std::unique_ptr<Node> sibling;
+        if( node.leaf ) {
+            sibling = std::make_unique<Leaf>();
+            ++_leaves;
+        } else {
+            sibling = std::make_unique<Inner>();
+            ++_inners;
+        }
+        transfer( node, node.count / 2, node.count, *sibling, 0 );
+        return sibling;
+    }
+
+    // Inserts entry as segment s under node. Returns the new right sibling
+    // of node if it had to be split.
+    std::unique_ptr<Node> insert_into( Node& node, size_t s, const Segment& entry, size_t length ) {
+        std::unique_ptr<Node> sibling;
+        if( node.leaf ) {
+            Node* target = &node;
+            if( node.count == B ) {
+                sibling = split_node( node );
+                if( s > node.count ) {
+                    s -= node.count;
+                    target = sibling.get();
+                }
+            }
+            open_slot( *target, s );
+            static_cast<Leaf*>(target)->entries[s] = entry;
+            target->elements[s] = length;
+            return sibling;
+        }
+
+        Inner& inner = static_cast<Inner&>(node);
+        size_t i = 0;
+        for( ; i + 1 < inner.count && s > inner.segments[i]; ++i )
+            s -= inner.segments[i];
+        std::unique_ptr<Node> child = insert_into( *inner.children[i], s, entry, length );
+        if( !child ) {
+            inner.elements[i] += length;
+            inner.segments[i] += 1;
+            return nullptr;
+        }
+
+        inner.elements[i] = total_elements( *inner.children[i] );
+        inner.segments[i] = total_segments( *inner.children[i] );
+        Node* target = &node;
+        size_t at = i + 1;
+        if( node.count == B ) {
+            sibling = split_node( node );
+            if( at > node.count ) {
+                at -= node.count;
+                target = sibling.get();
+            }
+        }
+        Inner& parent = static_cast<Inner&>(*target);
+        open_slot( parent, at );
+        parent.elements[at] = total_elements( *child );
+        parent.segments[at] = total_segments( *child );
+        parent.children[at] = std::move(child);
+        return sibling;
+    }
+
+    // Removes segment s under node, which may be left under-full, and
+    // returns its length
+    size_t erase_from( Node& node, size_t s ) {
+        if( node.leaf ) {
+            size_t length = node.elements[s];
+            close_slot( node, s );
+            return length;
+        }
+
+        Inner& inner = static_cast<Inner&>(node);
+        size_t i = 0;
+        for( ; s >= inner.segments[i]; ++i )
+            s -= inner.segments[i];
+        size_t length = erase_from( *inner.children[i], s );
+        inner.elements[i] -= length;
+        inner.segments[i] -= 1;
+        if( inner.children[i]->count < B / 2 )
+            rebalance( inner, i );
+        return length;
+    }
+
+    // Refills the under-full child i from a neighbour, merging the two when
+    // they fit in one node
+    void rebalance( Inner& inner, size_t i ) {
+        if( inner.count < 2 )
+            return;
+        size_t left = i > 0? i - 1 : i;
+        Node& a = *inner.children[left];
+        Node& b = *inner.children[left + 1];
+        if( a.count + b.count <= B ) {
+            transfer( b, 0, b.count, a, a.count );
+            inner.elements[left] += inner.elements[left + 1];
+            inner.segments[left] += inner.segments[left + 1];
+            --(a.leaf? _leaves : _inners);
+            close_slot( inner, left + 1 );
+            return;
+        }
+        size_t half = (a.count + b.count) / 2;
+        if( a.count < half )
+            transfer( b, 0, half - a.count, a, a.count );
+        else
+            transfer( a, half, a.count, b, 0 );
+        inner.elements[left] = total_elements( a );
+        inner.segments[left] = total_segments( a );
+        inner.elements[left + 1] = total_elements( b );
+        inner.segments[left + 1] = total_segments( b );
+    }
+
+    // Adds a root above the current one and its new sibling
+    void grow( std::unique_ptr<Node> sibling ) {
+        auto root = std::make_unique<Inner>();
+        ++_inners;
+        root->count = 2;
+        root->elements[0] = total_elements( *_root );
+        root->segments[0] = total_segments( *_root );
+        root->elements[1] = total_elements( *sibling );
+        root->segments[1] = total_segments( *sibling );
+        root->children[0] = std::move(_root);
+        root->children[1] = std::move(sibling);
+        _root = std::move(root);
+    }
+
+    // Removes roots with a single child
+    void shrink() {
+        while( !_root->leaf && _root->count == 1 ) {
+            std::unique_ptr<Node> child = std::move( static_cast<Inner&>(*_root).children[0] );
+            _root = std::move(child);
+            --_inners;
+        }
+    }
+
+    // Replaces segment s under node by entry of the given length, and
+    // returns the length of the segment it replaced
+    size_t resize( Node& node, size_t s, const Segment& entry, size_t length ) {
+        if( node.leaf ) {
+            size_t previous = node.elements[s];
+            static_cast<Leaf&>(node).entries[s] = entry;
+            node.elements[s] = length;
+            return previous;
+        }
+        Inner& inner = static_cast<Inner&>(node);
+        size_t i = 0;
+        for( ; s >= inner.segments[i]; ++i )
+            s -= inner.segments[i];
+        size_t previous = resize( *inner.children[i], s, entry, length );
+        inner.elements[i] = inner.elements[i] - previous + length;
+        return previous;
+    }
+
+    template < class F >
+    static void walk( const Node& node, F& f ) {
+        if( node.leaf ) {
+            const Leaf& leaf = static_cast<const Leaf&>(node);
+            for( size_t i = 0; i < leaf.count; ++i )
+                f( leaf.entries[i] );
+        } else {
+            const Inner& inner = static_cast<const Inner&>(node);
+            for( size_t i = 0; i < inner.count; ++i )
+                walk( *inner.children[i], f );
+        }
+    }
+
+    std::unique_ptr<Node> _root;
+    size_t                _elements = 0;
+    size_t                _segments = 0;
+    size_t                _leaves = 1;
+    size_t                _inners = 0;
+};
+
+} // namespace util
@@ -0,0 +1,148 @@
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Immutable concatenation of reference counted segments.
+//
+// Edits never modify a SharedMultiRange: they return a new version that
+// shares every untouched segment with the original and only copies the
+// segment being modified. Versions can be read concurrently while a writer
+// prepares the next one.
+template < class T >
+class SharedMultiRange {
+public:
+    using Segment = std::shared_ptr<const std::vector<T>>;
+    using iterator = typename MultiRange<const T*>::iterator;
+
+    // Segments up to this size are copied by push_back; larger ones are
+    // left alone and a new segment is started instead
+    static constexpr size_t max_copied_segment = 1024;
+
+    SharedMultiRange() :
+        SharedMultiRange( std::vector<Segment>() )
+    {
+    }
+
+    explicit SharedMultiRange( std::vector<Segment> segments ) :
+        _table( std::make_shared<const Table>( std::move(segments) ) )
+    {
+    }
+
+    // Copyable
+    SharedMultiRange( const SharedMultiRange& ) = default;
+    // Moveable
+    SharedMultiRange( SharedMultiRange&& ) = default;
+
+    SharedMultiRange& operator=( const SharedMultiRange& ) = default;
+    SharedMultiRange& operator=( SharedMultiRange&& ) = default;
+
+    iterator begin() const { return view().begin(); }
+    iterator end() const   { return view().end(); }
+
+    // Plain MultiRange over the segments of this version
+    MultiRange<const T*> view() const { return _table->view; }
+
+    size_t size() const { return _table->offsets.back(); }
+
+    size_t num_segments() const { return _table->segments.size(); }
+
+    const Segment& segment( size_t i ) const { return _table->segments[i]; }
+
+    // Memory of this version. Segments shared with other versions are
+    // counted in full by each of them.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage = _table->view.memory_usage();
+        usage.tables += _table->segments.capacity() * sizeof(Segment)
+                      + _table->offsets.capacity() * sizeof(size_t);
+        for( const Segment& segment : _table->segments )
+            usage.elements += segment->capacity() * sizeof(T);
+        return usage;
+    }
+
+    const T& operator[]( size_t index ) const {
+        auto position = locate( index );
+        return (*segment(position.first))[position.second];
+    }
+
+    // Version where the element at index is replaced by value
+    SharedMultiRange set( size_t index, T value ) const {
+        auto position = locate( index );
+        std::vector<Segment> segments = _table->segments;
+        auto copy = std::make_shared<std::vector<T>>( *segments[position.first] );
+        (*copy)[position.second] = std::move(value);
+        segments[position.first] = std::move(copy);
+        return SharedMultiRange( std::move(segments) );
+    }
+
+    // Version with value appended
+    SharedMultiRange push_back( T value ) const {
+        std::vector<Segment> segments = _table->segments;
+        if( !segments.empty() && segments.back()->size() < max_copied_segment ) {
+            auto copy = std::make_shared<std::vector<T>>( *segments.back() );
+            copy->push_back( std::move(value) );
+            segments.back() = std::move(copy);
+        } else {
+            segments.push_back( std::make_shared<const std::vector<T>>( 1, std::move(value) ) );
+        }
+        return SharedMultiRange( std::move(segments) );
+    }
+
+    // Version with a whole segment appended
+    SharedMultiRange append( Segment segment ) const {
+        std::vector<Segment> segments = _table->segments;
+        segments.push_back( std::move(segment) );
+        return SharedMultiRange( std::move(segments) );
+    }
+
+    SharedMultiRange append( std::vector<T> segment ) const {
+        return append( std::make_shared<const std::vector<T>>( std::move(segment) ) );
+    }
+
+private:
+    // Segments of a version together with their prefix sums and the
+    // MultiRange used to iterate them
+    struct Table {
+        explicit Table( std::vector<Segment> s ) :
+            segments( std::move(s) ),
+            offsets( segments.size() + 1 ),
+            view( make_view(segments) )
+        {
+            for( size_t i = 0; i < segments.size(); ++i )
+                offsets[i+1] = offsets[i] + segments[i]->size();
+        }
+
+        static MultiRange<const T*> make_view( const std::vector<Segment>& segments ) {
+            std::vector<range<const T*>> ranges;
+            ranges.reserve( segments.size() );
+            for( const Segment& segment : segments )
+                ranges.push_back( { segment->data(), segment->data() + segment->size() } );
+            return MultiRange<const T*>( ranges.begin(), ranges.end() );
+        }
+
+        std::vector<Segment> segments;
+        std::vector<size_t>  offsets;
+        MultiRange<const T*> view;
+    };
+
+    // Segment and offset inside it of the element at index
+    std::pair<size_t,size_t> locate( size_t index ) const {
+        assert( index < size() );
+        const std::vector<size_t>& offsets = _table->offsets;
+        size_t s = std::upper_bound( offsets.begin(), offsets.end(), index ) - offsets.begin() - 1;
+        return { s, index - offsets[s] };
+    }
+
+    std::shared_ptr<const Table> _table;
+};
+
+} // namespace util
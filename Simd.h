@@ -0,0 +1,299 @@
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MultiIterator.h"
+
+// Vectorized reductions and transforms over contiguous segments.
+//
+// Full vectors are loaded straight from each segment. Elements left over
+// at the end of a segment are not handled by a scalar loop: they are
+// carried into a vector of lanes that the head of the next segment
+// completes, so that short segments run at close to full vector width.
+// Only the very last partial vector of the whole MultiRange is padded.
+// Segments that are not tiny are first peeled up to a 64 byte boundary
+// (into the carried lanes as well), so that their body is read with
+// aligned loads; for segments from aligned pools there is nothing to peel.
+//
+// Operations receive vectors (GCC/Clang vector extensions) as well as
+// scalars, so they are written with operators and generic lambdas:
+//
+//   util::simd_reduce( ranges, 0, []( auto a, auto b ) { return a < b? a : b; } );
+//   util::simd_transform( ranges, []( auto v ) { return v * 2 + 1; } );
+//
+// Without vector extensions everything runs one element at a time.
+
+#ifndef UTIL_SIMD_BYTES
+#if defined(__AVX512F__)
+#define UTIL_SIMD_BYTES 64
+#elif defined(__AVX__)
+#define UTIL_SIMD_BYTES 32
+#else
+#define UTIL_SIMD_BYTES 16
+#endif
+#endif
+
+namespace util {
+
+namespace detail {
+
+template < class T >
+struct simd {
+#if defined(__GNUC__)
+    static constexpr size_t lanes = UTIL_SIMD_BYTES / sizeof(T);
+    typedef T type __attribute__((vector_size(UTIL_SIMD_BYTES)));
+#else
+    static constexpr size_t lanes = 1;
+    using type = T;
+#endif
+
+    static type load( const T* p ) {
+        type v;
+        std::memcpy( &v, p, sizeof(v) );
+        return v;
+    }
+
+    static type load_aligned( const T* p ) {
+        return *reinterpret_cast<const type*>(p);
+    }
+
+    template < bool Aligned >
+    static type load( const T* p ) {
+        return Aligned? load_aligned(p) : load(p);
+    }
+
+    static void store( T* p, const type& v ) {
+        std::memcpy( p, &v, sizeof(v) );
+    }
+};
+
+// Number of elements to skip from p to reach a 64 byte boundary, or -1
+// if elements of T never fall on one
+template < class T >
+std::ptrdiff_t peel_to_boundary( const T* p ) {
+    std::uintptr_t bytes = -reinterpret_cast<std::uintptr_t>(p) % 64;
+    return bytes % sizeof(T) == 0? std::ptrdiff_t(bytes / sizeof(T)) : -1;
+}
+
+// Calls full(p, position, aligned) for every whole vector found inside a
+// segment, position being the index of p[0] in the concatenation and
+// aligned a std::integral_constant telling whether p is on a 64 byte
+// boundary. Calls carried(lanes, where, positions, count) for every vector
+// assembled from segment heads and tails, where[i] being the address
+// lanes[i] was read from and positions[i] its index. The last carried
+// vector may have count < lanes; its missing lanes repeat lanes[0].
+template < class ContainerIt, class Full, class Carried >
+void for_each_vector( MultiRange<ContainerIt>& ranges, Full&& full, Carried&& carried ) {
+    static_assert( is_contiguous_iterator<ContainerIt>::value, "Segments are not contiguous" );
+    using T = std::remove_reference_t<typename std::iterator_traits<ContainerIt>::reference>;
+    using L = std::remove_cv_t<T>;
+    static_assert( std::is_arithmetic<L>::value, "Only arithmetic elements can be vectorized" );
+    constexpr size_t W = simd<L>::lanes;
+    constexpr bool aligned_vectors = 64 % sizeof(typename simd<L>::type) == 0;
+
+    L      lanes[W];
+    T*     where[W];
+    size_t positions[W];
+    size_t fill = 0;
+    size_t position = 0;
+
+    auto carry = [&]( T* p ) {
+        lanes[fill] = *p;
+        where[fill] = p;
+        positions[fill++] = position;
+        if( fill == W ) {
+            carried( lanes, where, positions, W );
+            fill = 0;
+        }
+    };
+
+    range<ContainerIt>* table = ranges.data();
+    for( size_t s = 0; s < ranges.size(); ++s ) {
+        auto segment = contiguous( table[s] );
+        T* p = segment.first;
+        T* e = segment.last;
+        UTIL_SEGMENT_SCOPE( table, s, e - p );
+        const SegmentLayout& layout = ranges.layout(s);
+
+        // Peel to the boundary, or just complete the carried vector
+        std::ptrdiff_t head = fill > 0? W - fill : 0;
+        bool aligned = false;
+        if( aligned_vectors && layout.length != LengthClass::tiny ) {
+            std::ptrdiff_t peel = layout.alignment >= 64? 0 : peel_to_boundary(p);
+            if( peel >= 0 && peel <= e - p ) {
+                head = peel;
+                aligned = true;
+            }
+        }
+        for( T* h = p + std::min<std::ptrdiff_t>( head, e - p ); p != h; ++p, ++position )
+            carry( p );
+
+        if( aligned ) {
+            for( ; size_t(e - p) >= W; p += W, position += W )
+                full( p, position, std::true_type() );
+        } else {
+            for( ; size_t(e - p) >= W; p += W, position += W )
+                full( p, position, std::false_type() );
+        }
+        for( ; p != e; ++p, ++position )
+            carry( p );
+    }
+
+    if( fill > 0 ) {
+        std::fill( lanes + fill, lanes + W, lanes[0] );
+        carried( lanes, where, positions, fill );
+    }
+}
+
+// Copies bytes with non-temporal stores, which do not pull the
+// destination into the cache. Needs a store fence before the data is
+// used by another thread.
+inline void stream_copy( void* destination, const void* source, size_t bytes ) {
+    char* out = static_cast<char*>(destination);
+    const char* in = static_cast<const char*>(source);
+#if defined(__SSE2__)
+    size_t peel = std::min<size_t>( -reinterpret_cast<std::uintptr_t>(out) % 64, bytes );
+    std::memcpy( out, in, peel );
+    out += peel;
+    in += peel;
+    bytes -= peel;
+    for( ; bytes >= 64; bytes -= 64, out += 64, in += 64 ) {
+        __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>(in) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>(in + 16) );
+        __m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>(in + 32) );
+        __m128i d = _mm_loadu_si128( reinterpret_cast<const __m128i*>(in + 48) );
+        _mm_stream_si128( reinterpret_cast<__m128i*>(out), a );
+        _mm_stream_si128( reinterpret_cast<__m128i*>(out + 16), b );
+        _mm_stream_si128( reinterpret_cast<__m128i*>(out + 32), c );
+        _mm_stream_si128( reinterpret_cast<__m128i*>(out + 48), d );
+    }
+#endif
+    std::memcpy( out, in, bytes );
+}
+
+inline void store_fence() {
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+} // namespace detail
+
+// Combines all the elements with op, which must be associative and
+// commutative and have identity as its neutral element
+template < class ContainerIt, class T, class Op >
+T simd_reduce( MultiRange<ContainerIt> ranges, T identity, Op op ) {
+    UTIL_TRACE_ALGORITHM( "simd_reduce", ranges.size() );
+    using simd = detail::simd<T>;
+    using V = typename simd::type;
+    constexpr size_t W = simd::lanes;
+    static_assert( std::is_same<T, typename std::iterator_traits<ContainerIt>::value_type>::value,
+                   "identity must have the type of the elements" );
+
+    V total = V{} + identity;
+    detail::for_each_vector( ranges,
+        [&]( const T* p, size_t, auto aligned ) {
+            total = op( total, simd::template load<decltype(aligned)::value>(p) );
+        },
+        [&]( T* lanes, const T* const*, const size_t*, size_t count ) {
+            std::fill( lanes + count, lanes + W, identity );
+            total = op( total, simd::load(lanes) );
+        });
+
+    T parts[W];
+    std::memcpy( parts, &total, sizeof(total) );
+    T result = identity;
+    for( size_t i = 0; i < W; ++i )
+        result = op( result, parts[i] );
+    return result;
+}
+
+// Sum of the elements
+template < class ContainerIt >
+auto simd_sum( MultiRange<ContainerIt> ranges ) {
+    using T = typename std::iterator_traits<ContainerIt>::value_type;
+    return simd_reduce( ranges, T(0), std::plus<>() );
+}
+
+// Writes f(x) for every element x to out, in order. f maps a vector to a
+// vector of the same type. Returns the end of the output.
+template < class ContainerIt, class T, class F >
+T* simd_transform( MultiRange<ContainerIt> ranges, T* out, F f ) {
+    UTIL_TRACE_ALGORITHM( "simd_transform", ranges.size() );
+    using simd = detail::simd<T>;
+
+    detail::for_each_vector( ranges,
+        [&]( const T* p, size_t position, auto aligned ) {
+            simd::store( out + position, f( simd::template load<decltype(aligned)::value>(p) ) );
+        },
+        [&]( T* lanes, const T* const*, const size_t* positions, size_t count ) {
+            T results[simd::lanes];
+            typename simd::type result = f( simd::load(lanes) );
+            std::memcpy( results, &result, sizeof(result) );
+            for( size_t i = 0; i < count; ++i )
+                out[positions[i]] = results[i];
+        });
+    return out + ranges.profile().elements;
+}
+
+// Replaces every element x by f(x)
+template < class ContainerIt, class F >
+void simd_transform( MultiRange<ContainerIt> ranges, F f ) {
+    UTIL_TRACE_ALGORITHM( "simd_transform", ranges.size() );
+    using T = typename std::iterator_traits<ContainerIt>::value_type;
+    using simd = detail::simd<T>;
+
+    detail::for_each_vector( ranges,
+        [&]( T* p, size_t, auto aligned ) {
+            simd::store( p, f( simd::template load<decltype(aligned)::value>(p) ) );
+        },
+        [&]( T* lanes, T* const* where, const size_t*, size_t count ) {
+            T results[simd::lanes];
+            typename simd::type result = f( simd::load(lanes) );
+            std::memcpy( results, &result, sizeof(result) );
+            for( size_t i = 0; i < count; ++i )
+                *where[i] = results[i];
+        });
+}
+
+// Copies the elements to out, in order, and returns the end of the
+// output. Segments of the huge length class are written with
+// non-temporal stores so that a large copy does not evict the cache.
+template < class ContainerIt, class T >
+T* simd_copy( MultiRange<ContainerIt> ranges, T* out ) {
+    UTIL_TRACE_ALGORITHM( "simd_copy", ranges.size() );
+    static_assert( std::is_trivially_copyable<T>::value, "Elements must be trivially copyable" );
+    static_assert( std::is_same<T, std::remove_cv_t<typename std::iterator_traits<ContainerIt>::value_type>>::value,
+                   "out must have the type of the elements" );
+    bool streamed = false;
+    range<ContainerIt>* table = ranges.data();
+    for( size_t s = 0; s < ranges.size(); ++s ) {
+        auto segment = contiguous( table[s] );
+        size_t length = segment.last - segment.first;
+        UTIL_SEGMENT_SCOPE( table, s, length );
+        if( ranges.layout(s).length == LengthClass::huge ) {
+            detail::stream_copy( out, segment.first, length * sizeof(T) );
+            streamed = true;
+        } else if( length > 0 ) {
+            std::memcpy( out, segment.first, length * sizeof(T) );
+        }
+        out += length;
+    }
+    if( streamed )
+        detail::store_fence();
+    return out;
+}
+
+} // namespace util
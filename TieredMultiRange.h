@@ -0,0 +1,291 @@
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "MultiIterator.h"
+
+namespace util {
+
+// Owning concatenation that keeps the segments it holds in RAM within a
+// MemoryBudget. Segments are tracked by recency of use; with
+// OverBudget::spill the least recently used ones are written once to a
+// spill file and either replaced by a read-only mmap of it
+// (SpillMode::map), or dropped and read back when they are used again
+// (SpillMode::drop). The segment being added or used always stays in RAM.
+// OverBudget::compact gives back the unused capacity of the segments in
+// RAM instead, and like OverBudget::refuse throws budget_exceeded if that
+// is not enough.
+//
+// Iteration goes through view(), a MultiRange<const T*> over wherever
+// the segments currently are. Pointers, views and iterators are
+// invalidated by push_back() and segment(), which may move segments
+// between tiers. POSIX only.
+template < class T >
+class TieredMultiRange {
+public:
+    static_assert( std::is_trivially_copyable<T>::value, "Elements are spilled as raw bytes" );
+
+    enum class SpillMode {
+        map,  // Cold segments become mmap views of the spill file
+        drop, // Cold segments are released and read back on use
+    };
+
+    enum class Tier {
+        hot,     // In RAM
+        mapped,  // Mapped from the spill file
+        dropped, // Only in the spill file
+    };
+
+    // The spill file is created at path and removed right away, so that
+    // it goes away with the process
+    TieredMultiRange( const std::string& path, MemoryBudget& budget, SpillMode mode = SpillMode::map ) :
+        TieredMultiRange( path, nullptr, &budget, mode )
+    {
+    }
+
+    // Spills past budget bytes of segments in RAM
+    TieredMultiRange( const std::string& path, size_t budget, SpillMode mode = SpillMode::map ) :
+        TieredMultiRange( path, std::make_unique<MemoryBudget>( budget, OverBudget::spill ), nullptr, mode )
+    {
+    }
+
+    // Not copyable, segments own mappings
+    TieredMultiRange( const TieredMultiRange& ) = delete;
+    TieredMultiRange& operator=( const TieredMultiRange& ) = delete;
+
+    ~TieredMultiRange() {
+        for( Segment& segment : _segments )
+            unmap( segment );
+        _budget->release( _hot_bytes );
+        ::close( _fd );
+    }
+
+    // Appends a segment, which starts hot
+    void push_back( std::vector<T> elements ) {
+        Segment segment;
+        segment.charged = elements.capacity() * sizeof(T);
+        admit( segment.charged, _segments.size() );
+        segment.length = elements.size();
+        segment.hot = std::move(elements);
+        segment.last_use = ++_clock;
+        _segments.push_back( std::move(segment) );
+    }
+
+    size_t num_segments() const { return _segments.size(); }
+
+    size_t size() const {
+        size_t total = 0;
+        for( const Segment& segment : _segments )
+            total += segment.length;
+        return total;
+    }
+
+    // Bytes of segments held in RAM
+    size_t hot_bytes() const { return _hot_bytes; }
+
+    const MemoryBudget& budget() const { return *_budget; }
+
+    // Segment table and segments in RAM. Mapped segments are backed by
+    // the spill file and not counted.
+    MemoryUsage memory_usage() const {
+        MemoryUsage usage;
+        usage.tables = _segments.capacity() * sizeof(Segment);
+        usage.elements = _hot_bytes;
+        return usage;
+    }
+
+    Tier tier( size_t i ) const { return _segments[i].tier; }
+
+    // Elements of a segment, marked as just used. A dropped segment is read
+    // back into RAM, which may push others out.
+    range<const T*> segment( size_t i ) {
+        Segment& segment = _segments[i];
+        segment.last_use = ++_clock;
+        if( segment.tier == Tier::dropped ) {
+            admit( bytes(segment), i );
+            segment.charged = bytes(segment);
+            segment.hot.resize( segment.length );
+            read_back( segment );
+            segment.tier = Tier::hot;
+        }
+        return elements( segment );
+    }
+
+    // MultiRange over all segments, where they are, which marks them all as
+    // used. Dropped segments are mapped for the view, which does not count
+    // against the budget; they stay dropped, and segment() still reads them
+    // back into RAM.
+    MultiRange<const T*> view() {
+        std::vector<range<const T*>> ranges;
+        ranges.reserve( _segments.size() );
+        for( Segment& segment : _segments ) {
+            if( segment.tier == Tier::dropped && !segment.mapping )
+                map( segment );
+            segment.last_use = ++_clock;
+            ranges.push_back( elements(segment) );
+        }
+        return MultiRange<const T*>( ranges.begin(), ranges.end() );
+    }
+
+private:
+    TieredMultiRange( const std::string& path, std::unique_ptr<MemoryBudget> own_budget,
+                      MemoryBudget* budget, SpillMode mode ) :
+        _own_budget( std::move(own_budget) ),
+        _budget( budget? budget : _own_budget.get() ),
+        _mode( mode ),
+        _page( size_t( sysconf(_SC_PAGESIZE) ) ),
+        _fd( ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600 ) )
+    {
+        if( _fd < 0 )
+            throw std::system_error( errno, std::generic_category(), "Can not create spill file " + path );
+        ::unlink( path.c_str() );
+    }
+
+    struct Segment {
+        std::vector<T> hot;
+        const T*       mapping = nullptr;
+        size_t         length = 0;
+        size_t         charged = 0; // Bytes charged for hot
+        off_t          offset = -1; // In the spill file, -1 until spilled
+        std::uint64_t  last_use = 0;
+        Tier           tier = Tier::hot;
+    };
+
+    static size_t bytes( const Segment& segment ) { return segment.length * sizeof(T); }
+
+    static range<const T*> elements( const Segment& segment ) {
+        const T* first = segment.tier == Tier::hot? segment.hot.data() : segment.mapping;
+        return { first, first + segment.length };
+    }
+
+    // Charges bytes for segment keep, making room as the budget says
+    void admit( size_t bytes, size_t keep ) {
+        bool compacted = false;
+        while( !_budget->try_charge( bytes ) ) {
+            if( _budget->action() == OverBudget::spill ) {
+                size_t victim = coldest( keep );
+                if( victim == _segments.size() ) {
+                    _budget->force_charge( bytes );
+                    break;
+                }
+                spill( _segments[victim] );
+            } else if( _budget->action() == OverBudget::compact && !compacted ) {
+                compact();
+                compacted = true;
+            } else {
+                throw budget_exceeded();
+            }
+        }
+        _hot_bytes += bytes;
+    }
+
+    // Least recently used segment in RAM other than keep, or
+    // num_segments() if there is none
+    size_t coldest( size_t keep ) const {
+        size_t victim = _segments.size();
+        for( size_t i = 0; i < _segments.size(); ++i ) {
+            const Segment& s = _segments[i];
+            if( i != keep && s.tier == Tier::hot && s.length > 0
+                && (victim == _segments.size() || s.last_use < _segments[victim].last_use) )
+                victim = i;
+        }
+        return victim;
+    }
+
+    void compact() {
+        for( Segment& segment : _segments ) {
+            if( segment.tier != Tier::hot || segment.charged == bytes(segment) )
+                continue;
+            segment.hot.shrink_to_fit();
+            size_t charged = segment.hot.capacity() * sizeof(T);
+            _budget->release( segment.charged - charged );
+            _hot_bytes -= segment.charged - charged;
+            segment.charged = charged;
+        }
+    }
+
+    void release( Segment& segment ) {
+        _budget->release( segment.charged );
+        _hot_bytes -= segment.charged;
+        segment.charged = 0;
+        std::vector<T>().swap( segment.hot );
+    }
+
+    void spill( Segment& segment ) {
+        if( segment.offset < 0 )
+            write_out( segment );
+        release( segment );
+        segment.tier = Tier::dropped;
+        if( _mode == SpillMode::map ) {
+            map( segment );
+            segment.tier = Tier::mapped;
+        }
+    }
+
+    // Appends the segment to the spill file at a page boundary, for mmap
+    void write_out( Segment& segment ) {
+        off_t offset = off_t( (_file_size + _page - 1) / _page * _page );
+        const char* data = reinterpret_cast<const char*>( segment.hot.data() );
+        for( size_t done = 0; done < bytes(segment); ) {
+            ssize_t n = ::pwrite( _fd, data + done, bytes(segment) - done, offset + done );
+            if( n < 0 && errno == EINTR )
+                continue;
+            if( n <= 0 )
+                throw std::system_error( n < 0? errno : EIO, std::generic_category(), "Can not write spill file" );
+            done += size_t(n);
+        }
+        segment.offset = offset;
+        _file_size = offset + bytes(segment);
+    }
+
+    void read_back( Segment& segment ) {
+        unmap( segment );
+        char* data = reinterpret_cast<char*>( segment.hot.data() );
+        for( size_t done = 0; done < bytes(segment); ) {
+            ssize_t n = ::pread( _fd, data + done, bytes(segment) - done, segment.offset + done );
+            if( n < 0 && errno == EINTR )
+                continue;
+            if( n <= 0 )
+                throw std::system_error( n < 0? errno : EIO, std::generic_category(), "Can not read spill file" );
+            done += size_t(n);
+        }
+    }
+
+    void map( Segment& segment ) {
+        void* p = ::mmap( nullptr, bytes(segment), PROT_READ, MAP_SHARED, _fd, segment.offset );
+        if( p == MAP_FAILED )
+            throw std::system_error( errno, std::generic_category(), "Can not map spill file" );
+        segment.mapping = static_cast<const T*>(p);
+    }
+
+    void unmap( Segment& segment ) {
+        if( segment.mapping ) {
+            ::munmap( const_cast<T*>(segment.mapping), bytes(segment) );
+            segment.mapping = nullptr;
+        }
+    }
+
+    std::vector<Segment>          _segments;
+    std::unique_ptr<MemoryBudget> _own_budget;
+    MemoryBudget*                 _budget;
+    SpillMode                     _mode;
+    size_t                        _page;
+    int                           _fd;
+    size_t                        _file_size = 0;
+    size_t                        _hot_bytes = 0;
+    std::uint64_t                 _clock = 0;
+};
+
+} // namespace util
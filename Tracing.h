@@ -0,0 +1,95 @@
+
+#pragma once
+
+#include <cstddef>
+
+// USDT static tracepoints for bpftrace, perf and other uprobe based tools.
+//
+// Probes are compiled in when <sys/sdt.h> is available, unless
+// UTIL_DISABLE_USDT is defined. Each probe is a single nop until a tracer
+// attaches to it. Provider name is multi_iterators:
+//
+//   segment__enter(table, index, length)  An iterator or algorithm starts on a segment
+//   segment__exit(table, index, length)   An iterator or algorithm is done with a segment
+//   algorithm__begin(name, segments)      A bulk algorithm starts
+//   algorithm__end(name, segments)        A bulk algorithm returns
+//
+// table is the address of the segment table, which identifies a
+// MultiRange. length is -1 when it can not be computed in constant time.
+// Iterators report leaving their last segment when they reach end().
+//
+// Example:
+//   bpftrace -e 'usdt:./a.out:multi_iterators:segment__enter { @len = hist(arg2); }'
+
+#if !defined(UTIL_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define UTIL_HAVE_USDT 1
+#endif
+#endif
+
+#if defined(UTIL_HAVE_USDT)
+
+namespace util {
+namespace trace {
+
+// Fires algorithm__begin and algorithm__end around a bulk algorithm
+class AlgorithmScope {
+public:
+    AlgorithmScope( const char* name, size_t segments ) :
+        _name( name ),
+        _segments( segments )
+    {
+        DTRACE_PROBE2( multi_iterators, algorithm__begin, _name, _segments );
+    }
+
+    ~AlgorithmScope() {
+        DTRACE_PROBE2( multi_iterators, algorithm__end, _name, _segments );
+    }
+
+private:
+    const char* _name;
+    size_t      _segments;
+};
+
+// Fires segment__enter and segment__exit around the processing of a segment
+class SegmentScope {
+public:
+    SegmentScope( const void* table, size_t index, std::ptrdiff_t length ) :
+        _table( table ),
+        _index( index ),
+        _length( length )
+    {
+        DTRACE_PROBE3( multi_iterators, segment__enter, _table, _index, _length );
+    }
+
+    ~SegmentScope() {
+        DTRACE_PROBE3( multi_iterators, segment__exit, _table, _index, _length );
+    }
+
+private:
+    const void*    _table;
+    size_t         _index;
+    std::ptrdiff_t _length;
+};
+
+} // namespace trace
+} // namespace util
+
+#define UTIL_TRACE_SEGMENT_ENTER(table, index, length) \
+    DTRACE_PROBE3( multi_iterators, segment__enter, (const void*)(table), (size_t)(index), (std::ptrdiff_t)(length) )
+#define UTIL_TRACE_SEGMENT_EXIT(table, index, length) \
+    DTRACE_PROBE3( multi_iterators, segment__exit, (const void*)(table), (size_t)(index), (std::ptrdiff_t)(length) )
+#define UTIL_TRACE_SEGMENT_SCOPE(table, index, length) \
+    ::util::trace::SegmentScope util_trace_segment_scope( (table), (index), (length) )
+#define UTIL_TRACE_ALGORITHM(name, segments) \
+    ::util::trace::AlgorithmScope util_trace_algorithm_scope( (name), (segments) )
+
+#else
+
+#define UTIL_TRACE_SEGMENT_ENTER(table, index, length) ((void)0)
+#define UTIL_TRACE_SEGMENT_EXIT(table, index, length) ((void)0)
+#define UTIL_TRACE_SEGMENT_SCOPE(table, index, length) ((void)0)
+#define UTIL_TRACE_ALGORITHM(name, segments) ((void)0)
+
+#endif
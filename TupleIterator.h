@@ -7,16 +7,10 @@
 
 #include <cassert>
 
-namespace util {
-
-template < class Iterator >
-struct range {
-    Iterator first;
-    Iterator last;
+#include "Memory.h"
+#include "Range.h"
 
-    Iterator begin() { return first; }
-    Iterator end()   { return last; }
-};
+namespace util {
 
 template < class ValueType, class... ContainerIt >
 struct StageHandlerBase {
@@ -24,11 +18,15 @@ struct StageHandlerBase {
 
     virtual bool done() const = 0;
 
-    virtual ValueType& get_element() = 0;
+    virtual ValueType& get_element() const = 0;
 
     virtual void next_element() = 0;
 
-    virtual void next_stage( std::tuple<range<ContainerIt>...>&, void* ) = 0;
+    virtual range<ValueType*> next_batch( size_t max_n ) = 0;
+
+    // Replaces this handler with the one of the next stage. Returns false,
+    // leaving this handler in place, if this is the last stage.
+    virtual bool next_stage( std::tuple<range<ContainerIt>...>&, void* ) = 0;
 
     virtual bool operator!=( const StageHandlerBase& other ) const = 0;
 };
@@ -47,7 +45,7 @@ struct StageHandler final : public StageHandlerBase<ValueType, ContainerIt...> {
         return _range.first == _range.last;
     }
 
-    ValueType& get_element() override {
+    ValueType& get_element() const override {
         return *_range.first;
     }
     
@@ -55,6 +53,15 @@ struct StageHandler final : public StageHandlerBase<ValueType, ContainerIt...> {
         _range.first++;
     }
 
+    range<ValueType*> next_batch( size_t max_n ) override {
+        size_t n = std::min<size_t>( max_n, 1 );
+        if constexpr( is_contiguous_iterator<decltype(_range.first)>::value )
+            n = std::min<size_t>( max_n, std::distance(_range.first, _range.last) );
+        ValueType* first = std::addressof(*_range.first);
+        std::advance( _range.first, n );
+        return { first, first + n };
+    }
+
     bool operator!=( const BaseType& other ) const override {
         const StageHandler* o = dynamic_cast<const StageHandler*>(&other);
         if( !o ) {
@@ -65,7 +72,7 @@ struct StageHandler final : public StageHandlerBase<ValueType, ContainerIt...> {
         }
     }
 
-    void next_stage( std::tuple<range<ContainerIt>...>& ranges, void* ptr ) override;
+    bool next_stage( std::tuple<range<ContainerIt>...>& ranges, void* ptr ) override;
 
     // Member variables
     Range _range;
@@ -91,12 +98,17 @@ struct StageFactory<ValueType,I,false,ContainerIt...> {
     }
 };
 
-// This just calls the factory
+// Destroys this handler and calls the factory. Nothing of this object may
+// be used once its destructor has run, the caller included.
 template < class ValueType, size_t I, class... ContainerIt >
-void StageHandler<ValueType, I, ContainerIt...>::next_stage( std::tuple<range<ContainerIt>...>& ranges, void* ptr )
+bool StageHandler<ValueType, I, ContainerIt...>::next_stage( std::tuple<range<ContainerIt>...>& ranges, void* ptr )
 {
     constexpr bool hasMoreStages = I < sizeof...(ContainerIt)-1;
+    if( !hasMoreStages )
+        return false;
+    this->~StageHandler();
     StageFactory<ValueType, I+1, hasMoreStages, ContainerIt...>()(ranges, ptr);
+    return true;
 }
 
 // Type trait to define a union
@@ -133,6 +145,9 @@ public:
     iterator begin();
     iterator end();
 
+    // The ranges are held inline, nothing is allocated
+    MemoryUsage memory_usage() const { return {}; }
+
 private:
     std::tuple<range<ContainerIt>...> _ranges;
 };
@@ -146,12 +161,20 @@ public:
     using value_type      = std::common_type_t<
                                 typename std::iterator_traits<ContainerIt>::value_type...
                             >;
-    using reference_type  = value_type&;
-    using pointer_type    = value_type*;
+    using reference       = value_type&;
+    using pointer         = value_type*;
     using difference_type = std::ptrdiff_t;
     using iterator_category = std::forward_iterator_tag;
+    using iterator_concept  = std::forward_iterator_tag;
 
-    iterator() = default;
+    // Behaves as the end of an empty last range
+    iterator() :
+        _ranges( nullptr ),
+        _handler()
+    {
+        constexpr size_t last_stage = sizeof...(ContainerIt)-1;
+        new(&_handler) StageHandler<value_type, last_stage, ContainerIt...>( {} );
+    }
 
     // Integral constant serves as a 'tag' to select which iterator in the
     // tuple is started from (for begin() this is 0)
@@ -164,10 +187,11 @@ public:
     template < size_t I >
     iterator( ranges_tuple& ranges, std::tuple_element_t<I, ranges_tuple> current,
               std::integral_constant<size_t,I> stage ) :
-        _ranges( ranges ),
+        _ranges( &ranges ),
         _handler()
     {
         new(&_handler) StageHandler<value_type, I, ContainerIt...>(current);
+        skip_done();
     }
 
     // Copyable
@@ -182,14 +206,8 @@ public:
 
     // Pre increment
     iterator& operator++() {
-        handler_base& handler = get_handler();
-        if( handler.done() ) {
-            // Replace current handler with next stage
-            handler.~handler_base();
-            handler.next_stage(_ranges, &_handler);
-        } else {
-            handler.next_element();
-        }
+        get_handler().next_element();
+        skip_done();
         return *this;
     }
 
@@ -201,19 +219,28 @@ public:
     }
 
     // De-reference
-    reference_type operator*() {
-        handler_base& handler = get_handler();
-        if( handler.done() ) {
-            // Replace current handler with next stage
-            handler.~handler_base();
-            handler.next_stage(_ranges, &_handler);
-        }
-        return handler.get_element();
+    reference operator*() const {
+        return get_handler().get_element();
     }
 
     // De-reference
-    pointer_type operator->() {
-        return get_handler().get_element();
+    pointer operator->() const {
+        return std::addressof(**this);
+    }
+
+    // Longest run of up to max_n elements starting here that does not
+    // cross a range, and moves past it. The run holds a single element
+    // when the range is not contiguous, and none at the end.
+    range<pointer> next_batch( size_t max_n ) {
+        if( get_handler().done() )
+            return { nullptr, nullptr };
+        range<pointer> batch = get_handler().next_batch( max_n );
+        skip_done();
+        return batch;
+    }
+
+    bool operator==( const iterator& other ) const {
+        return !(get_handler() != other.get_handler());
     }
 
     bool operator!=( const iterator& other ) const {
@@ -232,7 +259,14 @@ private:
         return reinterpret_cast<const handler_base&>(_handler);
     }
 
-    ranges_tuple&   _ranges;
+    // Moves past exhausted ranges, so that the iterator is only done at
+    // the end of the last range
+    void skip_done() {
+        while( get_handler().done() && get_handler().next_stage(*_ranges, &_handler) ) {
+        }
+    }
+
+    ranges_tuple*   _ranges;
     handler_storage _handler;
 };
 
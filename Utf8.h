@@ -0,0 +1,209 @@
+
+#pragma once
+
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "MultiIterator.h"
+
+namespace util {
+
+namespace detail {
+
+// Number of leading bytes below 0x80.
+// Checks 16 bytes at a time with SSE2 (8 bytes at a time otherwise).
+inline size_t ascii_prefix( const unsigned char* p, size_t n ) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for( ; i + 16 <= n; i += 16 ) {
+        __m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p + i) );
+        if( _mm_movemask_epi8(block) != 0 )
+            break;
+    }
+#else
+    for( ; i + 8 <= n; i += 8 ) {
+        std::uint64_t block;
+        std::memcpy( &block, p + i, sizeof(block) );
+        if( block & 0x8080808080808080ull )
+            break;
+    }
+#endif
+    while( i < n && p[i] < 0x80 )
+        i++;
+    return i;
+}
+
+// Discards decoded code points when only validating
+struct DiscardCodePoints {
+    void operator()( char32_t ) const {}
+};
+
+} // namespace detail
+
+// Incremental UTF-8 decoder.
+// Input can be fed in arbitrary pieces: a multi-byte sequence that is cut
+// at the end of a piece is completed with the first bytes of the next one,
+// so the result is the same as decoding all the pieces concatenated.
+class Utf8Decoder {
+public:
+    // Decodes [first,last), calling emit(code_point) for every complete
+    // code point. Returns false once invalid input has been found.
+    template < class It, class Emit = detail::DiscardCodePoints >
+    bool decode( It first, It last, Emit&& emit = Emit() ) {
+        static_assert( sizeof(*first) == 1, "Input must be a sequence of bytes" );
+        if constexpr( is_contiguous_iterator<It>::value ) {
+            if( first == last )
+                return !_error;
+            auto* data = reinterpret_cast<const unsigned char*>( std::addressof(*first) );
+            return decode_bytes( data, data + std::distance(first, last), emit );
+        } else {
+            for( ; first != last && !_error; ++first ) {
+                if( step( static_cast<unsigned char>(*first) ) )
+                    emit( _code_point );
+            }
+            return !_error;
+        }
+    }
+
+    // Whether the input seen so far is valid and ends at a code point boundary
+    bool complete() const { return !_error && _pending == 0; }
+
+    // Whether invalid input has been found
+    bool error() const { return _error; }
+
+private:
+    template < class Emit >
+    bool decode_bytes( const unsigned char* first, const unsigned char* last, Emit& emit ) {
+        constexpr bool discard = std::is_same<std::decay_t<Emit>,detail::DiscardCodePoints>::value;
+        while( first != last && !_error ) {
+            if( _pending == 0 ) {
+                // ASCII runs only need to be skipped (or widened)
+                size_t ascii = detail::ascii_prefix( first, last - first );
+                if constexpr( !discard ) {
+                    for( size_t i = 0; i < ascii; ++i )
+                        emit( char32_t(first[i]) );
+                }
+                first += ascii;
+                if( first == last )
+                    break;
+            }
+            if( step(*first++) )
+                emit( _code_point );
+        }
+        return !_error;
+    }
+
+    // Consumes one byte. Returns true when it completes a code point.
+    // Accepted sequences follow table 3-7 of the Unicode standard, which
+    // rules out overlong forms, surrogates and values above U+10FFFF.
+    bool step( unsigned char byte ) {
+        if( _pending == 0 ) {
+            if( byte < 0x80 ) {
+                _code_point = byte;
+                return true;
+            } else if( byte >= 0xC2 && byte <= 0xDF ) {
+                _code_point = byte & 0x1F;
+                _pending = 1;
+            } else if( byte >= 0xE0 && byte <= 0xEF ) {
+                _code_point = byte & 0x0F;
+                _pending = 2;
+                _lower = byte == 0xE0? 0xA0 : 0x80;
+                _upper = byte == 0xED? 0x9F : 0xBF;
+            } else if( byte >= 0xF0 && byte <= 0xF4 ) {
+                _code_point = byte & 0x07;
+                _pending = 3;
+                _lower = byte == 0xF0? 0x90 : 0x80;
+                _upper = byte == 0xF4? 0x8F : 0xBF;
+            } else {
+                _error = true;
+            }
+            return false;
+        }
+
+        if( byte < _lower || byte > _upper ) {
+            _error = true;
+            return false;
+        }
+        _code_point = (_code_point << 6) | (byte & 0x3F);
+        _lower = 0x80;
+        _upper = 0xBF;
+        return --_pending == 0;
+    }
+
+    char32_t      _code_point = 0;
+    unsigned      _pending = 0;
+    unsigned char _lower = 0x80;
+    unsigned char _upper = 0xBF;
+    bool          _error = false;
+};
+
+// Result of a transcoding operation
+template < class OutputIt >
+struct TranscodeResult {
+    bool     valid; // Whether the whole input was valid UTF-8
+    OutputIt out;   // End of the produced output
+};
+
+// Whether the concatenation of all segments is valid UTF-8
+template < class ContainerIt >
+bool validate_utf8( MultiRange<ContainerIt> ranges ) {
+    UTIL_TRACE_ALGORITHM( "validate_utf8", ranges.size() );
+    Utf8Decoder decoder;
+    for( range<ContainerIt>* r = ranges.data(); r != ranges.data() + ranges.size(); ++r ) {
+        UTIL_WHOLE_SEGMENT_SCOPE( ranges.data(), r - ranges.data(), *r );
+        if( !decoder.decode( r->begin(), r->end() ) )
+            return false;
+    }
+    return decoder.complete();
+}
+
+// Decodes the concatenation of all segments into UTF-32 code units.
+// Stops at the first invalid sequence.
+template < class ContainerIt, class OutputIt >
+TranscodeResult<OutputIt> utf8_to_utf32( MultiRange<ContainerIt> ranges, OutputIt out ) {
+    UTIL_TRACE_ALGORITHM( "utf8_to_utf32", ranges.size() );
+    Utf8Decoder decoder;
+    auto emit = [&]( char32_t code_point ) {
+        *out++ = code_point;
+    };
+    for( range<ContainerIt>* r = ranges.data(); r != ranges.data() + ranges.size(); ++r ) {
+        UTIL_WHOLE_SEGMENT_SCOPE( ranges.data(), r - ranges.data(), *r );
+        if( !decoder.decode( r->begin(), r->end(), emit ) )
+            break;
+    }
+    return { decoder.complete(), out };
+}
+
+// Decodes the concatenation of all segments into UTF-16 code units,
+// using surrogate pairs outside the basic multilingual plane.
+// Stops at the first invalid sequence.
+template < class ContainerIt, class OutputIt >
+TranscodeResult<OutputIt> utf8_to_utf16( MultiRange<ContainerIt> ranges, OutputIt out ) {
+    UTIL_TRACE_ALGORITHM( "utf8_to_utf16", ranges.size() );
+    Utf8Decoder decoder;
+    auto emit = [&]( char32_t code_point ) {
+        if( code_point < 0x10000 ) {
+            *out++ = char16_t(code_point);
+        } else {
+            code_point -= 0x10000;
+            *out++ = char16_t(0xD800 + (code_point >> 10));
+            *out++ = char16_t(0xDC00 + (code_point & 0x3FF));
+        }
+    };
+    for( range<ContainerIt>* r = ranges.data(); r != ranges.data() + ranges.size(); ++r ) {
+        UTIL_WHOLE_SEGMENT_SCOPE( ranges.data(), r - ranges.data(), *r );
+        if( !decoder.decode( r->begin(), r->end(), emit ) )
+            break;
+    }
+    return { decoder.complete(), out };
+}
+
+} // namespace util
@@ -0,0 +1,30 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+// Stand-in for <sys/sdt.h> that records probes instead of emitting them,
+// so that tests can build with probes enabled and check what they report
+
+namespace sdt_stub {
+
+struct Probe {
+    std::string   name;
+    std::intptr_t args[3];
+};
+
+inline std::vector<Probe>& probes() {
+    static std::vector<Probe> fired;
+    return fired;
+}
+
+} // namespace sdt_stub
+
+#define DTRACE_PROBE2(provider, name, arg1, arg2) \
+    ::sdt_stub::probes().push_back( { #name, { (std::intptr_t)(arg1), (std::intptr_t)(arg2), 0 } } )
+
+#define DTRACE_PROBE3(provider, name, arg1, arg2, arg3) \
+    ::sdt_stub::probes().push_back( { #name, { (std::intptr_t)(arg1), (std::intptr_t)(arg2), (std::intptr_t)(arg3) } } )
@@ -0,0 +1,43 @@
+#include "Numa.h"
+#include <iostream>
+#include <vector>
+
+int main() {
+    util::NumaTopology topology = util::NumaTopology::detect();
+    assert( topology.num_nodes() >= 1 );
+    std::printf("%zu node(s)\n", topology.num_nodes());
+
+    std::vector<int> n0(1000, 1), n1(2000, 2), n2(3000, 3);
+    auto ranges = util::iterate_over(n0, n1, n2);
+
+    // First touched memory has a home node (or -1 if the kernel can not tell)
+    std::vector<int> nodes = util::segment_home_nodes( ranges );
+    assert( nodes.size() == 3 );
+    for( int node : nodes )
+        assert( node >= -1 && node < int(topology.num_nodes()) );
+
+    std::vector<std::atomic<int>> visits(3);
+    std::atomic<long> sum(0);
+    util::NumaExecutor executor;
+    executor.for_each_segment( ranges, [&]( size_t i, util::range<std::vector<int>::iterator>& segment ) {
+        visits[i]++;
+        long partial = 0;
+        for( int v : segment )
+            partial += v;
+        sum += partial;
+    });
+    assert( sum == 1000 + 4000 + 9000 );
+    for( auto& count : visits )
+        assert( count == 1 );
+
+    // Hints for two nodes, one of them possibly missing on this machine
+    util::NumaTopology two_nodes{ { {0}, {0} } };
+    util::NumaExecutor hinted( two_nodes );
+    sum = 0;
+    hinted.for_each_segment( ranges, [&]( size_t, auto& segment ) {
+        for( int v : segment )
+            sum += v;
+    }, {1, -1, 7} );
+    assert( sum == 1000 + 4000 + 9000 );
+    return 0;
+}
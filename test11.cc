@@ -0,0 +1,45 @@
+#include "SharedMultiRange.h"
+#include <iostream>
+#include <vector>
+
+int main() {
+    using Shared = util::SharedMultiRange<int>;
+    Shared v0 = Shared().append( std::vector<int>{1, 2, 3} )
+                        .append( std::vector<int>{} )
+                        .append( std::vector<int>{4, 5} );
+    assert( v0.size() == 5 && v0.num_segments() == 3 );
+    assert( v0[0] == 1 && v0[3] == 4 && v0[4] == 5 );
+
+    // Replacing an element only copies its segment
+    Shared v1 = v0.set( 3, 40 );
+    assert( v0[3] == 4 && v1[3] == 40 );
+    assert( v1.segment(0) == v0.segment(0) );
+    assert( v1.segment(2) != v0.segment(2) );
+
+    // Appending to a small segment copies it, big segments are left alone
+    Shared v2 = v1.push_back( 6 );
+    assert( v2.size() == 6 && v2.num_segments() == 3 && v1.size() == 5 );
+    assert( v2.segment(0) == v0.segment(0) );
+
+    Shared big = Shared().append( std::vector<int>(Shared::max_copied_segment, 7) );
+    Shared bigger = big.push_back( 8 );
+    assert( bigger.num_segments() == 2 && bigger.segment(0) == big.segment(0) );
+
+    // Readers iterate every version independently
+    int sum = 0;
+    for( int value : v2 ) {
+        std::cout << value << " ";
+        sum += value;
+    }
+    std::cout << std::endl;
+    assert( sum == 1 + 2 + 3 + 40 + 5 + 6 );
+
+    sum = 0;
+    for( int value : v0 )
+        sum += value;
+    assert( sum == 1 + 2 + 3 + 4 + 5 );
+
+    Shared empty;
+    assert( empty.size() == 0 && !(empty.begin() != empty.end()) );
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "Algorithms.h"
+#include "Parallel.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// Vector storing its elements in fixed size chunks
+class ChunkedVector {
+public:
+    static constexpr size_t chunk_size = 4;
+
+    void push_back( int value ) {
+        if( _size % chunk_size == 0 )
+            _chunks.emplace_back( new int[chunk_size] );
+        _chunks.back()[_size++ % chunk_size] = value;
+    }
+
+    size_t size() const { return _size; }
+
+    template < class F >
+    void for_each_chunk( F f ) {
+        for( size_t i = 0; i < _chunks.size(); ++i ) {
+            size_t n = std::min( chunk_size, _size - i * chunk_size );
+            f( _chunks[i].get(), _chunks[i].get() + n );
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<int[]>> _chunks;
+    size_t                              _size = 0;
+};
+
+namespace util {
+
+template <>
+struct segment_traits<ChunkedVector> {
+    using iterator = int*;
+
+    template < class F >
+    static void for_each_segment( ChunkedVector& v, F f ) {
+        v.for_each_chunk( f );
+    }
+};
+
+} // namespace util
+
+int main() {
+    static_assert( util::is_segmented<ChunkedVector>::value, "" );
+    static_assert( !util::is_segmented<std::vector<int>>::value, "" );
+
+    ChunkedVector chunked;
+    for( int i = 0; i < 10; ++i )
+        chunked.push_back( i );
+    int head[] = { -2, -1 };
+
+    // Every chunk becomes a segment of its own
+    auto ranges = util::iterate_over( head, chunked );
+    assert( ranges.size() == 1 + 3 );
+
+    std::vector<int> expected;
+    for( int i = -2; i < 10; ++i )
+        expected.push_back(i);
+
+    std::vector<int> values;
+    for( int value : ranges ) {
+        std::cout << value << " ";
+        values.push_back( value );
+    }
+    std::cout << std::endl;
+    assert( values == expected );
+
+    // Segmented algorithms see the chunks as plain pointer ranges
+    util::MultiRange<int*> flat( { util::range<int*>{ expected.data(), expected.data() + expected.size() } } );
+    assert( util::equal( ranges, flat ) );
+    assert( util::any_of( ranges, []( int v ) { return v == 7; } ) );
+    assert( !util::any_of( ranges, []( int v ) { return v == 10; } ) );
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "MultiIterator.h"
+#include <iostream>
+#include <list>
+#include <vector>
+
+int main() {
+    std::vector<int> n0 = {1, 2, 3, 4, 5};
+    std::vector<int> n1 = {6, 7};
+    std::vector<int> n2 = {8, 9, 10};
+    auto ranges = util::iterate_over(n0, n1, n2);
+
+    // Batches never cross a segment
+    std::vector<size_t> sizes;
+    std::vector<int> values;
+    auto it = ranges.begin();
+    auto end = ranges.end();
+    while( it != end ) {
+        auto batch = it.next_batch(4);
+        sizes.push_back( batch.last - batch.first );
+        values.insert( values.end(), batch.first, batch.last );
+    }
+    assert( (sizes == std::vector<size_t>{4, 1, 2, 3}) );
+    assert( (values == std::vector<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}) );
+
+    // Batches and single steps can be mixed
+    it = ranges.begin();
+    ++it;
+    auto batch = it.next_batch(100);
+    assert( batch.first == &n0[1] && batch.last == n0.data() + n0.size() );
+    assert( *it == 6 );
+    assert( it.next_batch(0).first == it.next_batch(0).last );
+
+    // Lists are handed out one element at a time
+    std::list<int> l0 = {1, 2}, l1 = {3};
+    auto lists = util::iterate_over(l0, l1);
+    size_t batches = 0;
+    for( auto li = lists.begin(); li != lists.end(); ++batches ) {
+        auto b = li.next_batch(8);
+        assert( b.last - b.first == 1 );
+        std::printf("%d\n", *b.first);
+    }
+    assert( batches == 3 );
+    return 0;
+}
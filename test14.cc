@@ -0,0 +1,49 @@
+#include "Pipeline.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main() {
+    std::vector<int> n0(1000), n1(3), n2(700);
+    for( size_t i = 0; i < n0.size(); ++i ) n0[i] = int(i);
+    for( size_t i = 0; i < n1.size(); ++i ) n1[i] = int(i) - 5;
+    for( size_t i = 0; i < n2.size(); ++i ) n2[i] = int(i * 7 % 31);
+    auto ranges = util::iterate_over(n0, n1, n2);
+
+    // Same result as the hand written loop
+    long expected = 0;
+    size_t expected_count = 0;
+    std::vector<long> expected_values;
+    for( int v : ranges ) {
+        long square = long(v) * v;
+        if( square % 3 == 1 ) {
+            expected += square + 1;
+            expected_count++;
+            expected_values.push_back( square + 1 );
+        }
+    }
+
+    auto squares = util::pipe(ranges)
+                 | util::map( []( int v ) { return long(v) * v; } )
+                 | util::where( []( long v ) { return v % 3 == 1; } )
+                 | util::map( []( long v ) { return v + 1; } );
+    long total = squares | util::sum();
+    std::printf("%ld\n", total);
+    assert( total == expected );
+    assert( (squares | util::count()) == expected_count );
+    assert( (squares | util::to_vector()) == expected_values );
+
+    // Non contiguous segments and a fold into another type
+    std::list<int> l0 = {1, 2, 3}, l1 = {4, 5};
+    std::string digits = util::pipe( util::iterate_over(l0, l1) )
+                       | util::where( []( int v ) { return v != 3; } )
+                       | util::reduce( std::string(), []( std::string s, int v ) {
+                             return s + char('0' + v);
+                         });
+    assert( digits == "1245" );
+
+    // Nothing selected
+    assert( (util::pipe(ranges) | util::where( []( int ) { return false; } ) | util::sum()) == 0 );
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "Algorithms.h"
+#include <functional>
+#include <iostream>
+#include <vector>
+
+int main() {
+    // One buffer per worker, the number of workers is only known at run time
+    size_t workers = 5;
+    std::vector<std::vector<int>> buffers( workers );
+    int next = 0;
+    for( size_t w = 0; w < workers; ++w )
+        for( size_t i = 0; i < w * 3; ++i )
+            buffers[w].push_back( next++ );
+
+    std::vector<std::vector<int>*> pointers;
+    for( auto& buffer : buffers )
+        pointers.push_back( &buffer );
+
+    // Ranges point into the buffers themselves
+    auto ranges = util::iterate_over_all( pointers );
+    assert( ranges.size() == workers );
+    assert( ranges.data()[1].first == buffers[1].begin() );
+    int expected = 0;
+    for( int v : ranges )
+        assert( v == expected++ );
+    assert( expected == next );
+
+    // Writes go to the buffers
+    for( int& v : util::iterate_over_all( pointers ) )
+        v = -v;
+    assert( buffers[4].back() == -(next - 1) );
+
+    // Containers held directly or through reference_wrapper
+    const auto& constant = buffers;
+    auto by_value = util::iterate_over_all( constant );
+    std::vector<std::reference_wrapper<std::vector<int>>> references( buffers.begin(), buffers.end() );
+    auto by_reference = util::iterate_over_all( references );
+    assert( util::equal( by_value, by_reference ) );
+
+    std::vector<int> a = {1, 2}, b = {3};
+    int sum = 0;
+    for( int v : util::iterate_over_all( { &a, &b } ) )
+        sum += v;
+    std::printf("%d\n", sum);
+    assert( sum == 6 );
+    return 0;
+}
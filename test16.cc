@@ -0,0 +1,37 @@
+#include "Pipeline.h"
+#include <array>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+int main() {
+    int n0[] = {1, 2, 3};
+    std::vector<int> n1 = {4, 5};
+    std::array<int,3> n2 = {{6, 7, 8}};
+    const std::vector<int> n3 = {9};
+
+    // No common iterator type, but all contiguous ints: lowered to pointers
+    auto mixed = util::iterate_over(n0, n1, n2);
+    static_assert( std::is_same<decltype(mixed), util::MultiRange<int*>>::value, "" );
+    assert( mixed.data()[1].first == n1.data() );
+
+    int expected = 1;
+    for( int& v : mixed ) {
+        assert( v == expected++ );
+        v *= 10;
+    }
+    assert( n1[1] == 50 && n2[2] == 80 );
+
+    // A constant container makes every segment constant
+    auto with_const = util::iterate_over(n1, n2, n3);
+    static_assert( std::is_same<decltype(with_const), util::MultiRange<const int*>>::value, "" );
+    int sum = util::pipe(with_const) | util::sum();
+    std::printf("%d\n", sum);
+    assert( sum == 40 + 50 + 60 + 70 + 80 + 9 );
+
+    // Containers sharing an iterator type keep it
+    std::vector<int> n4 = {1};
+    auto same = util::iterate_over(n1, n4);
+    static_assert( std::is_same<decltype(same), util::MultiRange<std::vector<int>::iterator>>::value, "" );
+    return 0;
+}
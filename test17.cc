@@ -0,0 +1,62 @@
+#include "MultiIterator.h"
+#include <algorithm>
+#include <forward_list>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <numeric>
+#include <vector>
+
+template < class Container >
+using category_of = typename std::iterator_traits<
+        typename util::MultiRange<typename Container::iterator>::iterator>::iterator_category;
+
+int main() {
+    static_assert( std::is_same<category_of<std::vector<int>>, std::random_access_iterator_tag>::value, "" );
+    static_assert( std::is_same<category_of<std::list<int>>, std::bidirectional_iterator_tag>::value, "" );
+    static_assert( std::is_same<category_of<std::forward_list<int>>, std::forward_iterator_tag>::value, "" );
+#if defined(__cpp_lib_concepts)
+    static_assert( std::random_access_iterator<util::MultiRange<int*>::iterator> );
+    static_assert( std::bidirectional_iterator<util::MultiRange<std::list<int>::iterator>::iterator> );
+    static_assert( std::forward_iterator<util::MultiRange<std::forward_list<int>::iterator>::iterator> );
+#endif
+
+    // Empty segments anywhere are skipped
+    std::vector<int> n0, n1 = {5, 3, 9}, n2, n3 = {1, 7}, n4;
+    auto ranges = util::iterate_over(n0, n1, n2, n3, n4);
+    auto first = ranges.begin(), last = ranges.end();
+    assert( last - first == 5 );
+    assert( std::distance(first, last) == 5 );
+    assert( *first == 5 && first[3] == 1 && *(last - 1) == 7 );
+
+    auto it = first;
+    std::advance( it, 3 );
+    assert( *it == 1 && it.position() == 3 && it - first == 3 );
+    it -= 2;
+    assert( *it == 3 && first < it && it <= last && !(it > last) );
+    assert( std::next(first, 5) == last && std::prev(last, 5) == first );
+
+    // Standard algorithms across segments
+    std::sort( first, last );
+    assert( (n1 == std::vector<int>{1, 3, 5}) && (n3 == std::vector<int>{7, 9}) );
+    assert( *std::lower_bound( first, last, 6 ) == 7 );
+    std::reverse( first, last );
+    assert( n1[0] == 9 && n3[1] == 1 );
+    assert( std::accumulate( first, last, 0 ) == 25 );
+
+    const auto constant = ranges.begin();
+    assert( *constant == 9 );
+
+    std::vector<int> e0, e1;
+    auto empty = util::iterate_over(e0, e1);
+    assert( empty.begin() == empty.end() );
+
+    // Lists go both ways
+    std::list<int> l0 = {1, 2}, l1, l2 = {3};
+    auto lists = util::iterate_over(l0, l1, l2);
+    std::vector<int> backwards( std::make_reverse_iterator(lists.end()), std::make_reverse_iterator(lists.begin()) );
+    for( int v : backwards )
+        std::printf("%d\n", v);
+    assert( (backwards == std::vector<int>{3, 2, 1}) );
+    return 0;
+}
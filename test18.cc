@@ -0,0 +1,45 @@
+#include "Simd.h"
+#include <iostream>
+#include <vector>
+
+int main() {
+    // Short segments of every size, so that vectors cross many seams
+    std::vector<std::vector<int>> segments;
+    int next = 1;
+    for( int n = 0; n < 40; ++n ) {
+        segments.emplace_back();
+        for( int i = 0; i < n % 13; ++i )
+            segments.back().push_back( next++ % 97 );
+    }
+    auto ranges = util::iterate_over_all( segments );
+
+    long expected = 0;
+    int smallest = 1000;
+    std::vector<int> doubled;
+    for( int v : ranges ) {
+        expected += v;
+        smallest = std::min( smallest, v );
+        doubled.push_back( v * 2 + 1 );
+    }
+
+    int sum = util::simd_sum( ranges );
+    std::printf("%d\n", sum);
+    assert( sum == expected );
+    assert( util::simd_reduce( ranges, 1000, []( auto a, auto b ) { return a < b? a : b; } ) == smallest );
+
+    std::vector<int> out( doubled.size() );
+    assert( util::simd_transform( ranges, out.data(), []( auto v ) { return v * 2 + 1; } ) == out.data() + out.size() );
+    assert( out == doubled );
+
+    util::simd_transform( ranges, []( auto v ) { return v * 2 + 1; } );
+    std::vector<int> in_place( ranges.begin(), ranges.end() );
+    assert( in_place == doubled );
+
+    // Floating point, fewer elements than a vector
+    std::vector<float> f0 = {0.5f}, f1, f2 = {1.5f, 2.0f};
+    assert( util::simd_sum( util::iterate_over(f0, f1, f2) ) == 4.0f );
+
+    std::vector<double> d0, d1;
+    assert( util::simd_sum( util::iterate_over(d0, d1) ) == 0.0 );
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "Blocks.h"
+#include "Pipeline.h"
+#include <iostream>
+#include <list>
+#include <vector>
+
+int main() {
+    // Event buffer chain: lots of segments of 0 to 3 elements
+    std::vector<std::vector<int>> events( 20000 );
+    long expected = 0;
+    for( size_t i = 0; i < events.size(); ++i ) {
+        for( size_t k = 0; k < i % 4; ++k ) {
+            events[i].push_back( int(i + k) );
+            expected += int(i + k);
+        }
+    }
+    auto tiny = util::iterate_over_all( events );
+    assert( tiny.profile().strategy == util::SegmentStrategy::gather );
+    assert( tiny.profile().tiny_segments == events.size() );
+    assert( tiny.profile().elements == 30000 );
+
+    // Tiny segments are handed out in full blocks, in order
+    size_t blocks = 0;
+    long total = 0;
+    std::vector<int> seen;
+    util::for_each_block( tiny, 256, [&]( const int* block, size_t n ) {
+        assert( n <= 256 );
+        blocks++;
+        for( size_t i = 0; i < n; ++i )
+            total += block[i];
+        seen.insert( seen.end(), block, block + n );
+    });
+    assert( total == expected && blocks == (30000 + 255) / 256 );
+    assert( seen == std::vector<int>( tiny.begin(), tiny.end() ) );
+    assert( (util::pipe(tiny) | util::sum()) == expected );
+
+    // Long segments are handed out in place
+    std::vector<int> big0( 1000, 1 ), big1( 10, 2 ), big2( 500, 3 );
+    auto large = util::iterate_over( big0, big1, big2 );
+    assert( large.profile().strategy == util::SegmentStrategy::per_segment );
+    std::vector<const int*> starts;
+    util::for_each_block( large, 256, [&]( const int* block, size_t ) {
+        starts.push_back( block );
+    });
+    assert( starts.front() == big0.data() && starts.size() == 4 + 1 + 2 );
+    assert( starts[4] == big1.data() );
+
+    // Lists are gathered element by element
+    std::list<int> l0 = {1, 2}, l1 = {3};
+    auto lists = util::iterate_over( l0, l1 );
+    assert( lists.profile().strategy == util::SegmentStrategy::elementwise );
+    size_t count = 0;
+    util::for_each_block( lists, 2, [&]( const int*, size_t n ) { count += n; } );
+    assert( count == 3 );
+    std::printf("%ld\n", total);
+    return 0;
+}
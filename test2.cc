@@ -5,6 +5,9 @@
 #include <forward_list>
 
 int main() {
+#if defined(__cpp_lib_concepts)
+    static_assert( std::forward_iterator<util::MultiRange<int*, std::forward_list<int>::iterator>::iterator> );
+#endif
     int n0[] = {1,2,3,4};
     std::vector<int> n1({5,6,7,8});
     std::forward_list<int> n2({9,10,11,12});
@@ -13,5 +16,14 @@ int main() {
         std::printf("%d\n", v);
     }
 
+    // Contiguous runs of up to 3 elements, single elements from the list
+    auto ranges = util::iterate_over(n0, n1, n2);
+    auto it = ranges.begin();
+    std::vector<size_t> sizes;
+    for( auto batch = it.next_batch(3); batch.first != batch.last; batch = it.next_batch(3) )
+        sizes.push_back( batch.last - batch.first );
+    assert( (sizes == std::vector<size_t>{3, 1, 3, 1, 1, 1, 1, 1}) );
+    assert( ranges.memory_usage().total() == 0 );
+
     return 0;
 }
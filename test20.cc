@@ -0,0 +1,54 @@
+#include "Simd.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <cstdlib>
+
+int main() {
+    // Segments from an aligned pool, and the same data shifted by one
+    const size_t n = 1000;
+    int* pool = static_cast<int*>( std::aligned_alloc( 64, 4 * n * sizeof(int) ) );
+    for( size_t i = 0; i < 4 * n; ++i )
+        pool[i] = int(i % 101);
+    std::vector<util::range<int*>> segments = {
+        { pool, pool + n },             // Aligned
+        { pool + n + 1, pool + 2 * n }, // Needs peeling
+        { pool + 2 * n + 3, pool + 2 * n + 10 },
+        { pool + 3 * n + 5, pool + 4 * n },
+    };
+    util::MultiRange<int*> ranges( segments.begin(), segments.end() );
+    assert( ranges.layout(0).alignment == 64 && ranges.layout(0).length == util::LengthClass::small );
+    assert( ranges.layout(1).alignment == 4 );
+    assert( ranges.layout(2).length == util::LengthClass::tiny );
+
+    std::vector<int> expected( ranges.begin(), ranges.end() );
+    long sum = 0;
+    for( int v : expected )
+        sum += v;
+    assert( util::simd_sum( ranges ) == sum );
+
+    std::vector<int> out( expected.size() );
+    assert( util::simd_transform( ranges, out.data(), []( auto v ) { return v + 1; } ) == out.data() + out.size() );
+    for( size_t i = 0; i < out.size(); ++i )
+        assert( out[i] == expected[i] + 1 );
+
+    util::simd_transform( ranges, []( auto v ) { return v - 1; } );
+    size_t i = 0;
+    for( int v : ranges )
+        assert( v == expected[i++] - 1 );
+
+    // Huge segments are copied with streaming stores
+    std::vector<char> big( 3 << 20, 'x' ), small( 100, 'y' );
+    big[12345] = 'z';
+    auto chars = util::iterate_over( small, big, small );
+    assert( chars.layout(1).length == util::LengthClass::huge );
+    std::vector<char> copy( 1 + big.size() + 200 );
+    assert( util::simd_copy( chars, copy.data() + 1 ) == copy.data() + 1 + big.size() + 200 );
+    assert( copy[1] == 'y' && copy[101 + 12345] == 'z' && copy[101 + big.size()] == 'y' );
+    assert( std::equal( big.begin(), big.end(), copy.begin() + 101 ) );
+
+    std::printf("%ld\n", sum);
+    std::free( pool );
+    return 0;
+}
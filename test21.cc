@@ -0,0 +1,67 @@
+#include "TieredMultiRange.h"
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+using Tiered = util::TieredMultiRange<int>;
+
+static std::vector<int> segment_of( int first, size_t n ) {
+    std::vector<int> values( n );
+    std::iota( values.begin(), values.end(), first );
+    return values;
+}
+
+static long sum( Tiered& tiered ) {
+    long total = 0;
+    for( int value : tiered.view() )
+        total += value;
+    return total;
+}
+
+int main() {
+    const size_t n = 1000;
+    const long expected = long(4*n) * (4*n - 1) / 2;
+
+    // Room for two segments: the oldest ones are mapped from the spill file
+    Tiered mapped( "/tmp/test21.spill", 2 * n * sizeof(int) );
+    for( int s = 0; s < 4; ++s )
+        mapped.push_back( segment_of( s*n, n ) );
+    assert( mapped.size() == 4*n && mapped.num_segments() == 4 );
+    assert( mapped.hot_bytes() <= mapped.budget().limit() );
+    assert( mapped.tier(0) == Tiered::Tier::mapped && mapped.tier(1) == Tiered::Tier::mapped );
+    assert( mapped.tier(2) == Tiered::Tier::hot && mapped.tier(3) == Tiered::Tier::hot );
+    assert( mapped.segment(0).first[5] == 5 );
+    assert( sum( mapped ) == expected );
+
+    // Dropped segments are read back on use, pushing out the coldest one
+    Tiered dropped( "/tmp/test21.spill", 2 * n * sizeof(int), Tiered::SpillMode::drop );
+    for( int s = 0; s < 4; ++s )
+        dropped.push_back( segment_of( s*n, n ) );
+    assert( dropped.tier(0) == Tiered::Tier::dropped && dropped.tier(3) == Tiered::Tier::hot );
+    auto first = dropped.segment(0);
+    assert( first.last - first.first == long(n) && first.first[n-1] == int(n-1) );
+    assert( dropped.tier(0) == Tiered::Tier::hot && dropped.tier(2) == Tiered::Tier::dropped );
+    assert( dropped.hot_bytes() <= dropped.budget().limit() );
+    assert( sum( dropped ) == expected );
+    std::cout << sum( dropped ) << std::endl;
+
+    // Viewing leaves dropped segments dropped, and counts as a use of every
+    // segment: reading one back pushes out the first one viewed
+    assert( dropped.tier(1) == Tiered::Tier::dropped && dropped.tier(2) == Tiered::Tier::dropped );
+    auto second = dropped.segment(1);
+    assert( second.first[0] == int(n) && second.first[n-1] == int(2*n-1) );
+    assert( dropped.tier(1) == Tiered::Tier::hot && dropped.tier(0) == Tiered::Tier::dropped );
+    assert( dropped.tier(3) == Tiered::Tier::hot );
+    assert( dropped.segment(2).first[0] == int(2*n) && dropped.tier(2) == Tiered::Tier::hot );
+    assert( sum( dropped ) == expected );
+
+    // A segment bigger than the budget stays hot while it is in use
+    Tiered small( "/tmp/test21.spill", 16 );
+    small.push_back( segment_of( 0, n ) );
+    assert( small.tier(0) == Tiered::Tier::hot );
+    small.push_back( std::vector<int>() );
+    small.push_back( segment_of( n, n ) );
+    assert( small.tier(0) == Tiered::Tier::mapped && small.tier(2) == Tiered::Tier::hot );
+    assert( small.segment(1).first == small.segment(1).last );
+    return 0;
+}
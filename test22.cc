@@ -0,0 +1,94 @@
+#include "Compression.h"
+#include "SharedMultiRange.h"
+#include "TieredMultiRange.h"
+#include <iostream>
+#include <vector>
+
+using Tiered = util::TieredMultiRange<int>;
+
+int main() {
+    // Tables of a MultiRange are shared by its copies
+    std::vector<int> a(100), b(28);
+    auto ranges = util::iterate_over( a, b );
+    util::MemoryUsage usage = ranges.memory_usage();
+    assert( usage.elements == 0 );
+    assert( usage.tables == 2 * sizeof(util::range<int*>) + 3 * sizeof(size_t) + 2 * sizeof(util::SegmentLayout) );
+
+    // Versions count the segments they see
+    using Shared = util::SharedMultiRange<int>;
+    Shared shared = Shared().append( std::vector<int>(1000) ).append( std::vector<int>(24) );
+    usage = shared.memory_usage();
+    std::cout << "shared: " << usage.tables << " + " << usage.elements << std::endl;
+    assert( usage.elements == 1024 * sizeof(int) && usage.tables > 0 );
+
+    // Refused allocations leave the structure unchanged
+    util::MemoryBudget budget( 4096 );
+    {
+        Tiered tiered( "/tmp/test22.spill", budget );
+        tiered.push_back( std::vector<int>(512) );
+        assert( budget.used() == 2048 );
+        bool refused = false;
+        try {
+            tiered.push_back( std::vector<int>(1024) );
+        } catch( const util::budget_exceeded& ) {
+            refused = true;
+        }
+        assert( refused && tiered.num_segments() == 1 && budget.used() == 2048 );
+        assert( tiered.memory_usage().elements == 2048 );
+    }
+    assert( budget.used() == 0 );
+
+    // Compaction gives back unused capacity
+    util::MemoryBudget compacting( 4096, util::OverBudget::compact );
+    {
+        Tiered tiered( "/tmp/test22.spill", compacting );
+        std::vector<int> slack;
+        slack.reserve( 768 );
+        slack.resize( 256 );
+        tiered.push_back( std::move(slack) );
+        assert( compacting.used() == 768 * sizeof(int) );
+        tiered.push_back( std::vector<int>(512) );
+        assert( compacting.used() == 768 * sizeof(int) && tiered.tier(0) == Tiered::Tier::hot );
+    }
+    assert( compacting.used() == 0 );
+
+    // A shared budget spills from whichever structure is allocating
+    util::MemoryBudget spilling( 4096, util::OverBudget::spill );
+    {
+        Tiered first( "/tmp/test22.spill", spilling );
+        Tiered second( "/tmp/test22.spill", spilling );
+        first.push_back( std::vector<int>(512, 1) );
+        second.push_back( std::vector<int>(256, 2) );
+        second.push_back( std::vector<int>(512, 3) );
+        assert( second.tier(0) == Tiered::Tier::mapped && first.tier(0) == Tiered::Tier::hot );
+        assert( spilling.used() == 4096 );
+        long sum = 0;
+        for( int value : second.view() )
+            sum += value;
+        assert( sum == 256 * 2 + 512 * 3 );
+    }
+    assert( spilling.used() == 0 );
+
+    // Pool blocks are charged until trimmed
+    util::MemoryBudget blocks( 3 * 1024 );
+    {
+        util::BlockPool pool( 1024, &blocks );
+        auto b0 = pool.acquire();
+        auto b1 = pool.acquire();
+        auto b2 = pool.acquire();
+        bool refused = false;
+        try {
+            pool.acquire();
+        } catch( const util::budget_exceeded& ) {
+            refused = true;
+        }
+        assert( refused && pool.memory_usage().elements == 3 * 1024 );
+        b0.reset();
+        b1.reset();
+        auto b3 = pool.acquire();
+        pool.trim();
+        assert( blocks.used() == 2 * 1024 && pool.memory_usage().elements == 2 * 1024 );
+    }
+    assert( blocks.used() == 0 );
+    return 0;
+}
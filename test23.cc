@@ -0,0 +1,102 @@
+#include "SegmentTree.h"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using Piece = util::range<const char*>;
+
+// Text of a tree or of a list of pieces
+template < class Pieces >
+static std::string text( const Pieces& pieces ) {
+    std::string s;
+    for( const Piece& piece : pieces )
+        s.append( piece.first, piece.last );
+    return s;
+}
+
+int main() {
+    // Piece table editing with small nodes, so that edits split and merge them
+    const std::string original = "The quick brown fox jumps over the lazy dog";
+    const std::string added = "red slow cat ";
+    util::SegmentTree<const char*, 4> tree;
+    tree.push_back( { original.data(), original.data() + original.size() } );
+    tree.insert( 10, { added.data(), added.data() + 4 } );
+    tree.erase( 4, 10 );
+    std::string expected = "The red brown fox jumps over the lazy dog";
+    assert( tree.size() == expected.size() && tree[4] == 'r' && tree[8] == 'b' );
+
+    // Random edits against a flat list of pieces
+    std::mt19937 random( 42 );
+    std::vector<Piece> pieces;
+    tree.for_each_segment( [&]( const Piece& piece ) { pieces.push_back( piece ); } );
+    size_t most = 0;
+    for( int step = 0; step < 5000; ++step ) {
+        size_t length = tree.size();
+        switch( random() % 8 ) {
+        case 0: case 1: case 2: case 3: {
+            size_t s = random() % (pieces.size() + 1);
+            size_t first = random() % added.size();
+            Piece piece{ added.data() + first, added.data() + first + random() % (added.size() - first + 1) };
+            tree.insert_segment( s, piece );
+            pieces.insert( pieces.begin() + s, piece );
+            break;
+        }
+        case 4: case 5:
+            if( !pieces.empty() ) {
+                size_t s = random() % pieces.size();
+                tree.erase_segment( s );
+                pieces.erase( pieces.begin() + s );
+            }
+            break;
+        case 6:
+            if( length > 0 ) {
+                size_t index = random() % length;
+                size_t s = tree.split( index );
+                auto position = tree.locate( index );
+                assert( position.first == s && position.second == 0 );
+            }
+            pieces.clear();
+            tree.for_each_segment( [&]( const Piece& piece ) { pieces.push_back( piece ); } );
+            break;
+        case 7:
+            if( length > 0 ) {
+                size_t first = random() % length;
+                size_t last = first + random() % std::min<size_t>( 20, length - first + 1 );
+                expected = text( pieces );
+                expected.erase( first, last - first );
+                tree.erase( first, last );
+                pieces.clear();
+                tree.for_each_segment( [&]( const Piece& piece ) { pieces.push_back( piece ); } );
+                assert( text( pieces ) == expected );
+            }
+            break;
+        }
+        assert( tree.num_segments() == pieces.size() );
+        most = std::max( most, pieces.size() );
+        expected = text( pieces );
+        assert( tree.size() == expected.size() );
+        if( !expected.empty() ) {
+            size_t index = random() % expected.size();
+            assert( tree[index] == expected[index] );
+            auto position = tree.locate( index );
+            assert( tree.segment(position.first).first[position.second] == expected[index] );
+        }
+    }
+
+    std::string iterated;
+    for( char c : tree.view() )
+        iterated += c;
+    assert( iterated == text( pieces ) );
+    size_t nodes = tree.memory_usage().tables;
+    assert( most > 100 );
+    std::cout << tree.num_segments() << " segments, " << nodes << " bytes of nodes" << std::endl;
+
+    // Emptied trees shrink back to a single leaf
+    while( tree.num_segments() > 0 )
+        tree.erase_segment( tree.num_segments() / 2 );
+    util::SegmentTree<const char*, 4> empty;
+    assert( tree.size() == 0 && tree.memory_usage().tables == empty.memory_usage().tables );
+    assert( nodes > empty.memory_usage().tables );
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "MultiIterator.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main() {
+    // Segments of assorted lengths, some empty
+    std::mt19937 random( 7 );
+    std::vector<std::vector<int>> segments( 300 );
+    std::vector<int> all;
+    for( auto& segment : segments ) {
+        segment.resize( random() % 4 == 0? 0 : random() % 20 );
+        for( int& value : segment ) {
+            value = int(all.size());
+            all.push_back( value );
+        }
+    }
+    auto ranges = util::iterate_over_all( segments );
+    const size_t* offsets = ranges.offsets();
+    assert( offsets[ranges.size()] == all.size() );
+
+    // Galloping from any segment agrees with a binary search over all of them
+    for( size_t hint = 0; hint < ranges.size(); hint += 7 ) {
+        for( size_t position = 0; position < all.size(); ++position ) {
+            size_t expected = std::upper_bound( offsets, offsets + ranges.size() + 1, position ) - offsets - 1;
+            assert( util::detail::gallop_segment( offsets, ranges.size(), hint, position ) == expected );
+        }
+    }
+
+    // Sorted probes, then random ones
+    util::FingerCursor<std::vector<int>::iterator> cursor( ranges );
+    for( size_t position = 0; position < all.size(); position += 1 + random() % 5 )
+        assert( cursor[position] == all[position] );
+    for( int i = 0; i < 1000; ++i ) {
+        size_t position = random() % all.size();
+        assert( cursor[position] == all[position] );
+        assert( *cursor.at(position) == all[position] );
+        assert( cursor.at(position) - ranges.begin() == std::ptrdiff_t(position) );
+    }
+    assert( cursor.at(all.size()) == ranges.end() );
+
+    // Iterators jump with the same search, from the segment they are in
+    auto it = ranges.begin();
+    for( size_t position = 0; position + 37 < all.size(); position += 37 ) {
+        assert( *it == all[position] );
+        it += 37;
+    }
+    for( size_t position = it - ranges.begin(); position >= 11; position -= 11 ) {
+        assert( *it == all[position] );
+        it -= 11;
+    }
+    std::cout << all.size() << " elements in " << ranges.size() << " segments" << std::endl;
+    return 0;
+}
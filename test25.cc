@@ -0,0 +1,48 @@
+// Built against stub/sys/sdt.h, which records the probes that fire
+#include "Utf8.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#ifndef UTIL_HAVE_USDT
+#error "Probes are not enabled"
+#endif
+
+// Lengths reported by segment__enter
+static std::vector<std::intptr_t> entered_lengths() {
+    std::vector<std::intptr_t> lengths;
+    for( const sdt_stub::Probe& probe : sdt_stub::probes() ) {
+        if( probe.name == "segment__enter" )
+            lengths.push_back( probe.args[2] );
+    }
+    return lengths;
+}
+
+int main() {
+    // Contiguous segments report their length
+    std::vector<std::string> strings = { "h\xc3\xa9", "llo", "", " w\xc3", "\xb6rld" };
+    sdt_stub::probes().clear();
+    assert( util::validate_utf8( util::iterate_over_all( strings ) ) );
+    assert( sdt_stub::probes().front().name == "algorithm__begin" );
+    assert( sdt_stub::probes().back().name == "algorithm__end" );
+    assert( (entered_lengths() == std::vector<std::intptr_t>{ 3, 3, 0, 3, 4 }) );
+
+    // Lists would have to be walked, so their length is not traced
+    std::vector<std::list<char>> lists;
+    for( const std::string& s : strings )
+        lists.emplace_back( s.begin(), s.end() );
+    sdt_stub::probes().clear();
+    assert( util::validate_utf8( util::iterate_over_all( lists ) ) );
+    assert( (entered_lengths() == std::vector<std::intptr_t>( lists.size(), -1 )) );
+
+    // Every segment__enter has its segment__exit
+    size_t enters = 0, exits = 0;
+    for( const sdt_stub::Probe& probe : sdt_stub::probes() ) {
+        enters += probe.name == "segment__enter";
+        exits += probe.name == "segment__exit";
+    }
+    assert( enters == lists.size() && exits == enters );
+
+    std::cout << "Probes fired as expected" << std::endl;
+}
@@ -0,0 +1,117 @@
+#include "Parallel.h"
+#include <iostream>
+#include <list>
+#include <vector>
+
+int main() {
+    std::vector<int> n0({1,2,3,4});
+    std::vector<int> n1({5,6,7,8,9,10});
+    std::vector<int> n2({11,12});
+
+    std::vector<int> even(12), odd(12);
+    auto ends = util::partition_copy( util::iterate_over(n0, n1, n2),
+                                      []( int v ) { return v % 2 == 0; },
+                                      even.begin(), odd.begin() );
+    even.erase( ends.first, even.end() );
+    odd.erase( ends.second, odd.end() );
+    assert( (even == std::vector<int>{2,4,6,8,10,12}) );
+    assert( (odd == std::vector<int>{1,3,5,7,9,11}) );
+
+    std::vector<std::vector<int>> buckets(3);
+    util::bucketize( util::iterate_over(n0, n1, n2),
+                     []( int v ) { return v % 3; },
+                     buckets );
+    for( size_t b = 0; b < buckets.size(); ++b ) {
+        std::printf("bucket %zu:", b);
+        for( int v : buckets[b] )
+            std::printf(" %d", v);
+        std::printf("\n");
+    }
+    assert( (buckets[0] == std::vector<int>{3,6,9,12}) );
+    assert( (buckets[2] == std::vector<int>{2,5,8,11}) );
+
+    // One large segment followed by many tiny ones
+    std::vector<int> large(100000);
+    for( size_t i = 0; i < large.size(); ++i )
+        large[i] = int(i);
+    std::vector<util::range<int*>> segments{ {large.data(), large.data() + 50000} };
+    for( size_t i = 50000; i < large.size(); i += 5 )
+        segments.push_back( {large.data() + i, large.data() + i + 5} );
+    util::MultiRange<int*> chained( segments.begin(), segments.end() );
+
+    std::vector<int> multiples(large.size()), others(large.size());
+    auto chained_ends = util::partition_copy( chained, []( int v ) { return v % 7 == 0; },
+                                              multiples.begin(), others.begin(), "test" );
+    assert( chained_ends.first - multiples.begin() == 14286 );
+    assert( std::is_sorted( multiples.begin(), chained_ends.first ) );
+    assert( std::is_sorted( others.begin(), chained_ends.second ) );
+    assert( util::AdaptiveExecutor::global().grain("test") > 0 );
+
+    // Chunks cover every element once and in order
+    util::SegmentIndex<int*> index( chained );
+    auto chunks = util::AdaptiveExecutor::global().for_each_chunk( index, "test", []( util::Chunk ) {} );
+    size_t covered = 0;
+    for( util::Chunk chunk : chunks ) {
+        assert( chunk.first == covered );
+        covered = chunk.last;
+    }
+    assert( covered == large.size() );
+
+    // A match in the first slice of a chunk ends the walk over the chunk
+    int slices = 0;
+    index.for_each_slice( util::Chunk{ 50000, 50020 }, [&]( size_t, int*, int* ) { return ++slices == 1; } );
+    assert( slices == 1 );
+    slices = 0;
+    index.for_each_slice( util::Chunk{ 50000, 50020 }, [&]( size_t, int*, int* ) { ++slices; } );
+    assert( slices == 4 );
+
+    // Searches pair every element they look at with its own position, and
+    // stop looking in a chunk once it has a match
+    bool misplaced = false;
+    size_t where = util::detail::parallel_find( index, [&]( int* element, size_t position ) {
+        misplaced |= *element != int(position);
+        return *element % 1000 == 501;
+    }, util::CancellationToken(), "test" );
+    assert( where == 501 && !misplaced );
+
+    // List segments are only cut between segments, where reaching the
+    // start of a chunk does not walk a list
+    std::vector<std::list<int>> lists( 3 );
+    for( int i = 0; i < 60000; ++i )
+        lists[i / 20000].push_back( i );
+    auto listed = util::iterate_over( lists[0], lists[1], lists[2] );
+    util::SegmentIndex<std::list<int>::iterator> list_index( listed );
+    for( util::Chunk chunk : util::AdaptiveExecutor::global().for_each_chunk( list_index, "lists", []( util::Chunk ) {} ) )
+        assert( chunk.first % 20000 == 0 && chunk.last % 20000 == 0 );
+    std::vector<int> list_even(60000), list_odd(60000);
+    auto list_ends = util::partition_copy( listed, []( int v ) { return v % 2 == 0; },
+                                           list_even.begin(), list_odd.begin(), "lists" );
+    assert( list_ends.first - list_even.begin() == 30000 && list_ends.second - list_odd.begin() == 30000 );
+    assert( list_even[12345] == 24690 && list_odd[29999] == 59999 );
+
+    // Early exit searches, first match in concatenation order
+    auto found = util::find_if( chained, []( int v ) { return v > 60000 && v % 1000 == 0; } );
+    assert( found != chained.end() && *found == 61000 );
+    assert( util::any_of( chained, []( int v ) { return v == 99999; } ) );
+    assert( !util::any_of( chained, []( int v ) { return v < 0; } ) );
+    int needle[] = {50003, 50004, 50005, 50006}; // Crosses a segment boundary
+    auto occurrence = util::search( chained, std::begin(needle), std::end(needle) );
+    assert( occurrence != chained.end() && *occurrence == 50003 );
+    assert( !(util::search( chained, std::begin(needle) + 1, std::begin(needle) + 1 ) != chained.begin()) );
+
+    util::CancellationToken token;
+    token.cancel();
+    assert( !(util::find_if( chained, []( int v ) { return v == 5; }, token ) != chained.end()) );
+    // Cancelling after the first match was found keeps it
+    util::CancellationToken late;
+    auto first = util::find_if( chained, [&]( int v ) {
+        if( v != 5 )
+            return false;
+        late.cancel();
+        return true;
+    }, late );
+    assert( first != chained.end() && *first == 5 );
+    auto expired = util::CancellationToken::with_timeout( std::chrono::nanoseconds(0) );
+    assert( expired.cancelled() );
+    return 0;
+}
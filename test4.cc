@@ -0,0 +1,26 @@
+#include "Algorithms.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main() {
+    std::string a0("hello "), a1("wor"), a2("ld");
+    std::vector<char> b0({'h','e'}), b1({'l','l','o',' ','w','o','r','l','d'});
+    std::vector<char> c0({'h','e','l','p'});
+    std::list<char> d0({'h','e','l','l','o',' ','w'}), d1({'o','r','l','d','!'});
+
+    assert( util::equal( util::iterate_over(a0, a1, a2), util::iterate_over(b0, b1) ) );
+    assert( !util::equal( util::iterate_over(a0, a1, a2), util::iterate_over(d0, d1) ) );
+    assert( util::compare( util::iterate_over(a0, a1, a2), util::iterate_over(b0, b1) ) == 0 );
+    assert( util::compare( util::iterate_over(b0, b1), util::iterate_over(c0) ) < 0 );
+    assert( util::compare( util::iterate_over(a0, a1, a2), util::iterate_over(d0, d1) ) < 0 );
+    assert( util::compare( util::iterate_over(d0, d1), util::iterate_over(b0, b1) ) > 0 );
+
+    auto b = util::iterate_over(b0, b1);
+    auto c = util::iterate_over(c0);
+    auto diff = util::mismatch( b, c );
+    std::printf("%c %c\n", *diff.first, *diff.second);
+    assert( *diff.first == 'l' && *diff.second == 'p' );
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "Utf8.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main() {
+    // "añ€𝄞" with multi-byte sequences cut by the segment boundaries
+    std::string text("a\xC3\xB1\xE2\x82\xAC\xF0\x9D\x84\x9E ascii tail to cover the block loop");
+    std::string s0 = text.substr(0, 2), s1 = text.substr(2, 3), s2 = text.substr(5, 2), s3 = text.substr(7);
+    assert( util::validate_utf8( util::iterate_over(s0, s1, s2, s3) ) );
+
+    std::u32string utf32;
+    auto r32 = util::utf8_to_utf32( util::iterate_over(s0, s1, s2, s3), std::back_inserter(utf32) );
+    assert( r32.valid );
+    assert( utf32.substr(0, 5) == U"añ€\U0001D11E " );
+
+    std::u16string utf16;
+    auto r16 = util::utf8_to_utf16( util::iterate_over(s0, s1, s2, s3), std::back_inserter(utf16) );
+    assert( r16.valid );
+    assert( utf16.substr(0, 6) == u"añ€\U0001D11E " );
+    std::printf("%zu code points, %zu code units\n", utf32.size(), utf16.size());
+
+    // Truncated sequence, overlong form and surrogate
+    std::list<char> l0({'a', '\xE2', '\x82'});
+    std::string overlong("\xC0\xAF"), surrogate("\xED\xA0\x80");
+    assert( !util::validate_utf8( util::iterate_over(l0) ) );
+    assert( !util::validate_utf8( util::iterate_over(overlong) ) );
+    assert( !util::validate_utf8( util::iterate_over(surrogate) ) );
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "Parse.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main() {
+    // Numbers cut at segment boundaries
+    std::string s0("12,-3"), s1("4, 56\n7"), s2("8,,9000000000,");
+    std::vector<long> longs = util::parse_numbers<long>( util::iterate_over(s0, s1, s2), ',' );
+    assert( (longs == std::vector<long>{12,-34,56,78,9000000000}) );
+
+    std::string f0("1.5;2.2"), f1("5;2"), f2("5e-2;0.25");
+    std::vector<double> doubles = util::parse_numbers<double>( util::iterate_over(f0, f1, f2), ';' );
+    assert( (doubles == std::vector<double>{1.5,2.25,0.25,0.25}) );
+    for( double v : doubles )
+        std::printf("%g\n", v);
+
+    std::list<char> l0({'1','0',' '}), l1({'2','0'});
+    assert( (util::parse_numbers<int>( util::iterate_over(l0, l1), ' ' ) == std::vector<int>{10,20}) );
+
+    std::string bad("1,x,3");
+    bool thrown = false;
+    try {
+        util::parse_numbers<int>( util::iterate_over(bad), ',' );
+    } catch( std::invalid_argument& ) {
+        thrown = true;
+    }
+    assert( thrown );
+    return 0;
+}
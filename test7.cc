@@ -0,0 +1,51 @@
+#include "Algorithms.h"
+#include "Compression.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() {
+    std::string s0, s1("tiny"), s2;
+    for( int i = 0; i < 500; ++i )
+        s0 += "record " + std::to_string(i % 37) + ";";
+    for( int i = 0; i < 3000; ++i )
+        s2 += char('a' + (i * 7919) % 26);
+
+    // Small blocks so that some of them span several segments
+    std::vector<char> compressed = util::compress( util::iterate_over(s0, s1, s2), util::Lz4Codec(), 1000 );
+    std::printf("%zu bytes compressed to %zu\n", s0.size() + s1.size() + s2.size(), compressed.size());
+    assert( compressed.size() < s0.size() + s1.size() + s2.size() );
+
+    // Compressed stream split at arbitrary places
+    std::vector<char> c0( compressed.begin(), compressed.begin() + 5 );
+    std::vector<char> c1( compressed.begin() + 5, compressed.begin() + 700 );
+    std::vector<char> c2( compressed.begin() + 700, compressed.end() );
+
+    util::BlockPool pool(1000);
+    util::DecompressedBlocks blocks = util::decompress( util::iterate_over(c0, c1, c2), pool );
+    assert( blocks.size() == s0.size() + s1.size() + s2.size() );
+    assert( util::equal( blocks.ranges(), util::iterate_over(s0, s1, s2) ) );
+
+    c2.pop_back();
+    bool thrown = false;
+    try {
+        util::decompress( util::iterate_over(c0, c1, c2), pool );
+    } catch( std::runtime_error& ) {
+        thrown = true;
+    }
+    assert( thrown );
+
+    // A corrupt size is rejected before anything is read or allocated
+    std::vector<char> h0( compressed.begin(), compressed.begin() + 8 );
+    std::vector<char> h1( compressed.begin() + 8, compressed.end() );
+    h0[4] = h0[5] = h0[6] = char(0xff);
+    h0[7] = 0x7f;
+    std::string error;
+    try {
+        util::decompress( util::iterate_over(h0, h1), pool );
+    } catch( std::runtime_error& e ) {
+        error = e.what();
+    }
+    assert( error == "decompress: corrupt block" );
+    return 0;
+}
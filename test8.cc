@@ -0,0 +1,28 @@
+#include "RecordBatch.h"
+#include <iostream>
+#include <optional>
+#include <vector>
+
+int main() {
+    std::vector<int> n0({0,1,2,3,4,5,6}), n1({7,8}), n2({9,10,11});
+
+    auto batches = util::to_record_batches( util::iterate_over(n0, n1, n2), 3 );
+    assert( batches.size() == 4 );
+    for( auto& batch : batches ) {
+        std::printf("%zu rows%s:", batch.length, batch.storage? " (copied)" : "");
+        for( size_t i = 0; i < batch.length; ++i )
+            std::printf(" %d", batch.values[i]);
+        std::printf("\n");
+    }
+    // First two batches reference the first segment, the seam is copied
+    assert( batches[0].values == n0.data() && batches[1].values == n0.data() + 3 );
+    assert( batches[2].storage && batches[2].values[0] == 6 && batches[2].values[2] == 8 );
+    assert( batches[3].values == n2.data() );
+
+    std::vector<std::optional<double>> o0({1.5, std::nullopt}), o1({2.5});
+    auto nullable = util::to_record_batches( util::iterate_over(o0, o1), 4 );
+    assert( nullable.size() == 1 && nullable[0].length == 3 && nullable[0].null_count == 1 );
+    assert( nullable[0].valid(0) && !nullable[0].valid(1) && nullable[0].valid(2) );
+    assert( nullable[0].values[2] == 2.5 );
+    return 0;
+}
@@ -0,0 +1,34 @@
+#define UTIL_ENABLE_METRICS
+#include "MultiIterator.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() {
+    std::vector<int> n0({1,2,3,4}), n1({5,6}), n2({7,8,9});
+
+    auto ranges = util::iterate_over(n0, n1, n2);
+    util::metrics::set_name( ranges.data(), "numbers" );
+    int sum = 0;
+    for( int round = 0; round < 10; ++round ) {
+        for( int v : ranges )
+            sum += v;
+    }
+    assert( sum == 450 );
+
+    auto tables = util::metrics::Registry::instance().snapshot();
+    assert( tables.size() == 0 ); // Not flushed yet
+
+    std::string json = util::metrics::to_json();
+    std::printf("%s", json.c_str());
+    tables = util::metrics::Registry::instance().snapshot();
+    const util::metrics::TableCounters& counters = tables[ranges.data()];
+    assert( counters.size() == 3 );
+    assert( counters[0].transitions == 10 && counters[0].elements == 40 );
+    assert( counters[1].transitions == 10 && counters[1].elements == 20 );
+    assert( counters[2].transitions == 10 && counters[2].elements == 30 );
+
+    std::string prometheus = util::metrics::to_prometheus();
+    assert( prometheus.find("multi_iterators_segment_elements_total{range=\"numbers\",segment=\"1\"} 20") != std::string::npos );
+    return 0;
+}